@@ -0,0 +1,80 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+void arena_init(arena_t *arena, size_t object_size)
+{
+	/**
+	 * Every object must hold the link of the free list
+	 * and keep the next ones aligned
+	 */
+	if (object_size < sizeof(void *))
+		object_size = sizeof(void *);
+	object_size = (object_size + sizeof(void *) - 1) &
+				  ~(sizeof(void *) - 1);
+
+	arena->blocks = NULL;
+	arena->top = NULL;
+	arena->limit = NULL;
+	arena->object_size = object_size;
+	arena->block_objects = ARENA_FIRST_BLOCK;
+	arena->free_list = NULL;
+	arena->bytes = 0;
+}
+
+void *arena_alloc(arena_t *arena)
+{
+	if (arena->free_list) {
+		void *object = arena->free_list;
+		arena->free_list = *(void **)object;
+		return object;
+	}
+
+	/**
+	 * A new block twice as large as the previous one is chained
+	 * when the current one is full
+	 */
+	if (arena->top == arena->limit) {
+		size_t size = sizeof(void *) +
+					  arena->block_objects * arena->object_size;
+
+		void **block = malloc(size);
+		DIE(!block, "Malloc for arena block failed");
+
+		*block = arena->blocks;
+		arena->blocks = block;
+		arena->top = (char *)(block + 1);
+		arena->limit = (char *)block + size;
+		arena->bytes += size;
+
+		if (arena->block_objects < ARENA_MAX_BLOCK)
+			arena->block_objects *= 2;
+	}
+
+	void *object = arena->top;
+	arena->top += arena->object_size;
+
+	return object;
+}
+
+void arena_release(arena_t *arena, void *object)
+{
+	*(void **)object = arena->free_list;
+	arena->free_list = object;
+}
+
+void arena_destroy(arena_t *arena)
+{
+	while (arena->blocks) {
+		void *previous = *(void **)arena->blocks;
+		free(arena->blocks);
+		arena->blocks = previous;
+	}
+
+	arena->top = NULL;
+	arena->limit = NULL;
+	arena->free_list = NULL;
+	arena->bytes = 0;
+}
@@ -0,0 +1,62 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#include "utils.h"
+
+#define ARENA_FIRST_BLOCK 1024  // objects in the first block of an arena
+#define ARENA_MAX_BLOCK (1 << 20)  // maximum objects in a block
+
+/**
+ * Hands out objects of a single size from large blocks, bumping a pointer
+ * through the current block. Released objects are kept in a free list and
+ * handed out again first. All the blocks are freed at once.
+ */
+typedef struct arena_t arena_t;
+struct arena_t {
+	void *blocks; // last block, each one starts with the previous one
+	char *top; // first free byte of the last block
+	char *limit; // end of the last block
+	size_t object_size; // size of an object, a multiple of a pointer
+	size_t block_objects; // number of objects of the next block
+	void *free_list; // released objects, linked through their first bytes
+	size_t bytes; // bytes taken by all the blocks
+};
+
+/**
+ * @brief The function prepares an empty arena for objects of the given size.
+ * 
+ * @param arena the arena
+ * @param object_size the size of an object
+ */
+void arena_init(arena_t *arena, size_t object_size);
+
+/**
+ * @brief The function returns an uninitialized object, reusing
+ * a released one if there is any.
+ * 
+ * @param arena the arena
+ * @return void* the object
+ */
+void *arena_alloc(arena_t *arena);
+
+/**
+ * @brief The function gives the object back to the arena, which will
+ * hand it out again.
+ * 
+ * @param arena the arena
+ * @param object the object
+ */
+void arena_release(arena_t *arena, void *object);
+
+/**
+ * @brief The function frees all the blocks of the arena, and with
+ * them every object handed out.
+ * 
+ * @param arena the arena
+ */
+void arena_destroy(arena_t *arena);
+
+#endif /* ARENA_H */
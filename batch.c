@@ -0,0 +1,87 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "batch.h"
+
+static void *batch_worker(void *arg)
+{
+	batch_t *batch = arg;
+
+	while (1) {
+		/**
+		 * Takes the next chunk of queries, the only shared state
+		 */
+		pthread_mutex_lock(&batch->lock);
+		int lo = batch->next;
+		batch->next += BATCH_CHUNK;
+		pthread_mutex_unlock(&batch->lock);
+
+		if (lo >= batch->count)
+			break;
+
+		int hi = lo + BATCH_CHUNK < batch->count ? lo + BATCH_CHUNK :
+												   batch->count;
+
+		for (int i = lo; i < hi; i++) {
+			int *target = batch->queries + (size_t)i * *batch->k;
+
+			if (batch->flat) {
+				batch->result[i] = flat_nn(batch->flat, target);
+			} else {
+				node_t *nearest = nn(batch->bst->root, target, batch->k, 0);
+				batch->result[i] = nearest ? nearest->coord : NULL;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+void nn_batch(bst_t *bst, flat_t *flat, int *queries, int count, int *k,
+			  int **result, int threads)
+{
+	batch_t batch;
+	batch.bst = bst;
+	batch.flat = flat;
+	batch.queries = queries;
+	batch.result = result;
+	batch.count = count;
+	batch.k = k;
+	batch.next = 0;
+	pthread_mutex_init(&batch.lock, NULL);
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads <= 0)
+		threads = 1;
+
+	/**
+	 * There is no point in starting workers that wouldn't get a chunk
+	 */
+	if (threads > (count + BATCH_CHUNK - 1) / BATCH_CHUNK)
+		threads = (count + BATCH_CHUNK - 1) / BATCH_CHUNK;
+
+	pthread_t *workers = malloc((threads + 1) * sizeof(pthread_t));
+	DIE(!workers, "Malloc for workers failed");
+
+	/**
+	 * The calling thread works too, as the last worker
+	 */
+	for (int i = 0; i < threads - 1; i++) {
+		int err = pthread_create(&workers[i], NULL, batch_worker, &batch);
+		DIE(err, "Creating a batch worker failed");
+	}
+
+	batch_worker(&batch);
+
+	for (int i = 0; i < threads - 1; i++)
+		pthread_join(workers[i], NULL);
+
+	free(workers);
+	pthread_mutex_destroy(&batch.lock);
+}
@@ -0,0 +1,41 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <pthread.h>
+
+#include "bst.h"
+#include "flat.h"
+
+#define BATCH_CHUNK 256  // queries taken at once by a worker
+
+typedef struct batch_t batch_t;
+struct batch_t {
+	bst_t *bst; /* the tree searched when there is no flat tree */
+	flat_t *flat; /* the flat tree, NULL if the points are in the bst */
+	int *queries; /* coordinates of the queries, k for each */
+	int **result; /* nearest point of every query */
+	int count; /* number of queries */
+	int *k; /* dimensions */
+
+	int next; /* first query not taken by a worker */
+	pthread_mutex_t lock; /* guards next */
+};
+
+/**
+ * @brief The function answers count nearest neighbour queries in parallel.
+ * The tree is only read, so the workers share it without locking and every
+ * answer is written in its own slot of the result, keeping the input order.
+ * 
+ * @param bst the bst
+ * @param flat the flat tree, NULL to search the bst
+ * @param queries the queries' coordinates, one after another
+ * @param count number of queries
+ * @param k dimensions
+ * @param result receives the coordinates of the nearest point of each query
+ * @param threads number of workers, 0 to use one per online core
+ */
+void nn_batch(bst_t *bst, flat_t *flat, int *queries, int count, int *k,
+			  int **result, int threads);
+
+#endif /* BATCH_H */
@@ -0,0 +1,102 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../bst.h"
+#include "../flat.h"
+#include "stats.h"
+
+/**
+ * Random queries against random points with ann() and flat_ann() for
+ * growing values of eps: the nodes visited and the time of a query, and
+ * the worst ratio between the distance found and the nearest one, which
+ * must stay under 1 + eps. The last rows cap the nodes visited instead.
+ *
+ * Usage: bench_ann [points] [dimensions] [queries]
+ */
+
+static void run(bst_t *bst, flat_t *flat, int *queries, dist_t *exact,
+				int count, int k, double eps, int max_visited)
+{
+	long bst_visited = 0, flat_visited = 0;
+	double worst = 1, bst_time, flat_time;
+
+	double start = stats_now();
+	for (int i = 0; i < count; i++) {
+		int *target = queries + (size_t)i * k, visited;
+		node_t *found = ann(bst->root, target, eps, max_visited, &k,
+							&visited);
+		double ratio = exact[i] ?
+			sqrt((double)distance(found->coord, target, &k) / (double)exact[i]) : 1;
+
+		bst_visited += visited;
+		if (ratio > worst)
+			worst = ratio;
+	}
+	bst_time = stats_now() - start;
+
+	start = stats_now();
+	for (int i = 0; i < count; i++) {
+		int *target = queries + (size_t)i * k, visited;
+		int *found = flat_ann(flat, target, eps, max_visited, &visited);
+		double ratio = exact[i] ?
+			sqrt((double)distance(found, target, &k) / (double)exact[i]) : 1;
+
+		flat_visited += visited;
+		if (ratio > worst)
+			worst = ratio;
+	}
+	flat_time = stats_now() - start;
+
+	printf("%5.2f %6d  %9.1f %8.2f  %9.1f %8.2f  %6.3f\n", eps, max_visited,
+		   (double)bst_visited / count, bst_time / count * 1e6,
+		   (double)flat_visited / count, flat_time / count * 1e6, worst);
+}
+
+int main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : 1000000;
+	int k = argc > 2 ? atoi(argv[2]) : 8;
+	int count = argc > 3 ? atoi(argv[3]) : 2000;
+
+	srand(42);
+
+	int *points = malloc((size_t)n * k * sizeof(int));
+	int *queries = malloc((size_t)count * k * sizeof(int));
+	dist_t *exact = malloc(count * sizeof(dist_t));
+	DIE(!points || !queries || !exact, "Malloc for the bench failed");
+
+	for (size_t i = 0; i < (size_t)n * k; i++)
+		points[i] = rand() % 2000001 - 1000000;
+	for (size_t i = 0; i < (size_t)count * k; i++)
+		queries[i] = rand() % 2000001 - 1000000;
+
+	bst_t *bst = bst_create_tree();
+	bst_bulk_load(bst, points, n, &k);
+	flat_t *flat = flat_create(bst, &k, FLAT_BUCKET);
+
+	for (int i = 0; i < count; i++) {
+		int *target = queries + (size_t)i * k;
+		exact[i] = distance(nn(bst->root, target, &k, 0)->coord, target, &k);
+	}
+
+	printf("%d points of %d dimensions, %d queries\n", n, k, count);
+	printf("  eps    max  bst nodes  bst us  flat pts  flat us  worst\n");
+
+	double eps[] = {0, 0.1, 0.25, 0.5, 1, 2};
+	for (size_t i = 0; i < sizeof(eps) / sizeof(eps[0]); i++)
+		run(bst, flat, queries, exact, count, k, eps[i], 0);
+
+	int caps[] = {1000, 100};
+	for (size_t i = 0; i < sizeof(caps) / sizeof(caps[0]); i++)
+		run(bst, flat, queries, exact, count, k, 0, caps[i]);
+
+	flat_free(flat);
+	bst_free_tree(bst);
+	free(points);
+	free(queries);
+	free(exact);
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../bst.h"
+#include "../flat.h"
+#include "stats.h"
+
+/**
+ * Measures the nearest neighbour and range queries of the flat tree for
+ * several leaf bucket sizes, against the one point per node bst.
+ *
+ * Usage: bench_bucket [points] [dimensions] [queries]
+ */
+
+static void count_point(int *coord, int *k, void *data)
+{
+	(void)coord;
+	(void)k;
+	(*(long *)data)++;
+}
+
+int main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : 200000;
+	int k = argc > 2 ? atoi(argv[2]) : 16;
+	int queries = argc > 3 ? atoi(argv[3]) : 2000;
+	int buckets[] = {1, 8, 32, 64, 128, 256};
+
+	srand(42);
+
+	/**
+	 * The points are grouped in clusters, as high-dimensional data
+	 * usually is, otherwise every query visits the whole tree
+	 */
+	int *points = malloc((size_t)n * k * sizeof(int));
+	int *targets = malloc((size_t)queries * k * sizeof(int));
+	int *low = malloc(k * sizeof(int));
+	int *high = malloc(k * sizeof(int));
+	DIE(!points || !targets || !low || !high, "Malloc for benchmark failed");
+
+	for (int i = 0; i < n; i++) {
+		int center = rand() % 64;
+		for (int j = 0; j < k; j++)
+			points[(size_t)i * k + j] = center * 10000 + rand() % 1000;
+	}
+	for (int q = 0; q < queries; q++) {
+		int *point = points + (size_t)(rand() % n) * k;
+		for (int j = 0; j < k; j++)
+			targets[(size_t)q * k + j] = point[j] + rand() % 100 - 50;
+	}
+
+	bst_t *bst = bst_create_tree();
+	bst_bulk_load(bst, points, n, &k);
+
+	printf("points %d, dimensions %d, queries %d\n", bst->size, k, queries);
+
+	double start = stats_now();
+	for (int q = 0; q < queries; q++)
+		nn(bst->root, targets + (size_t)q * k, &k, 0);
+	double elapsed = stats_now() - start;
+
+	long found = 0;
+	double start_rs = stats_now();
+	for (int q = 0; q < queries; q++) {
+		for (int j = 0; j < k; j++) {
+			low[j] = targets[(size_t)q * k + j] - 300;
+			high[j] = targets[(size_t)q * k + j] + 300;
+		}
+		rs(bst->root, low, high, 0, &k, count_point, &found);
+	}
+	double elapsed_rs = stats_now() - start_rs;
+
+	printf("bst          NN %10.0f q/s  RS %10.0f q/s\n",
+		   queries / elapsed, queries / elapsed_rs);
+
+	for (size_t b = 0; b < sizeof(buckets) / sizeof(buckets[0]); b++) {
+		flat_t *flat = flat_create(bst, &k, buckets[b]);
+
+		start = stats_now();
+		for (int q = 0; q < queries; q++)
+			flat_nn(flat, targets + (size_t)q * k);
+		elapsed = stats_now() - start;
+
+		found = 0;
+		start_rs = stats_now();
+		for (int q = 0; q < queries; q++) {
+			for (int j = 0; j < k; j++) {
+				low[j] = targets[(size_t)q * k + j] - 300;
+				high[j] = targets[(size_t)q * k + j] + 300;
+			}
+			flat_rs(flat, low, high, count_point, &found);
+		}
+		elapsed_rs = stats_now() - start_rs;
+
+		printf("bucket %4d  NN %10.0f q/s  RS %10.0f q/s\n", buckets[b],
+			   queries / elapsed, queries / elapsed_rs);
+
+		flat_free(flat);
+	}
+
+	bst_free_tree(bst);
+	free(high);
+	free(low);
+	free(targets);
+	free(points);
+
+	return 0;
+}
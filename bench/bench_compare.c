@@ -0,0 +1,94 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../utils.h"
+
+/**
+ * Compares two reports of the replays, from two versions, and prints the
+ * change of the throughput and of the latency percentiles of every command
+ * found in both. A command regressed if its throughput dropped or its p99
+ * latency grew by more than the threshold; the exit code is 1 if one did.
+ *
+ * Usage: bench_compare <old report> <new report> [threshold %]
+ */
+
+#define COMPARE_LINES 256
+
+typedef struct result_t result_t;
+struct result_t {
+	char workload[64];
+	char command[16];
+	long count;
+	double seconds, ops_per_s, p50, p99, p999;
+};
+
+static int read_report(char *filename, result_t *results)
+{
+	FILE *in = fopen(filename, "rt");
+	DIE(!in, "Can't open the report");
+
+	char line[512];
+	int count = 0;
+
+	while (count < COMPARE_LINES && fgets(line, sizeof(line), in)) {
+		result_t *r = &results[count];
+		if (sscanf(line, "{\"workload\": \"%63[^\"]\", \"command\": "
+				   "\"%15[^\"]\", \"count\": %ld, \"seconds\": %lf, "
+				   "\"ops_per_s\": %lf, \"p50_us\": %lf, \"p99_us\": %lf, "
+				   "\"p999_us\": %lf}", r->workload, r->command, &r->count,
+				   &r->seconds, &r->ops_per_s, &r->p50, &r->p99,
+				   &r->p999) == 8)
+			count++;
+	}
+
+	fclose(in);
+	return count;
+}
+
+static double change(double before, double after)
+{
+	return before > 0 ? (after - before) / before * 100 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	DIE(argc < 3, "Usage: bench_compare <old> <new> [threshold %]");
+
+	double threshold = argc > 3 ? atof(argv[3]) : 10;
+	result_t *before = malloc(COMPARE_LINES * sizeof(result_t));
+	result_t *after = malloc(COMPARE_LINES * sizeof(result_t));
+	DIE(!before || !after, "Malloc for the reports failed");
+
+	int old_count = read_report(argv[1], before);
+	int new_count = read_report(argv[2], after);
+	int regressions = 0;
+
+	printf("%-12s %-12s %9s %9s %9s %9s\n", "workload", "command",
+		   "ops/s %", "p50 %", "p99 %", "p999 %");
+
+	for (int i = 0; i < new_count; i++) {
+		result_t *b = NULL, *a = &after[i];
+		for (int j = 0; j < old_count && !b; j++)
+			if (!strcmp(before[j].workload, a->workload) &&
+				!strcmp(before[j].command, a->command))
+				b = &before[j];
+		if (!b)
+			continue;
+
+		double throughput = change(b->ops_per_s, a->ops_per_s);
+		double p99 = change(b->p99, a->p99);
+		int regressed = throughput < -threshold || p99 > threshold;
+		regressions += regressed;
+
+		printf("%-12s %-12s %+9.1f %+9.1f %+9.1f %+9.1f%s\n", a->workload,
+			   a->command, throughput, change(b->p50, a->p50), p99,
+			   change(b->p999, a->p999), regressed ? "  REGRESSION" : "");
+	}
+
+	free(before);
+	free(after);
+
+	return regressions ? 1 : 0;
+}
@@ -0,0 +1,201 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../trie.h"
+#include "stats.h"
+
+/**
+ * Searches running in many threads while a writer inserts and removes
+ * words. The words of an even length are inserted before the threads start
+ * and are never removed, so every search must find them; the writer churns
+ * words of an odd length, which share prefixes with them.
+ *
+ * Prints the searches per second for 1, 2, 4, ... readers. With "stress"
+ * it also runs autocorrect() and the ranked autocomplete() in the readers
+ * and exits with 1 if a search missed a word (make tsan runs it this way).
+ *
+ * Usage: bench_concurrent [seconds] [max readers] [stress]
+ */
+
+#define STABLE_WORDS 50000
+#define CHURN_WORDS 100000
+
+static char stable[STABLE_WORDS][12];
+static char churn[CHURN_WORDS][12];
+
+typedef struct worker_t worker_t;
+struct worker_t {
+	trie_t *trie;
+	int id; // slot of the reader
+	int stress; // 1 to also run the searches that print
+	int *stop;
+	long ops; // searches or writes done
+	long missed; // stable words not found
+	unsigned int seed;
+	pthread_t thread;
+};
+
+static void random_word(char *word, int len, unsigned int *seed)
+{
+	for (int i = 0; i < len; i++)
+		word[i] = 'a' + rand_r(seed) % 8;
+	word[len] = '\0';
+}
+
+static void print_word(const char *word, void *data)
+{
+	(void)data;
+	printf("%s\n", word);
+}
+
+static void *reader(void *arg)
+{
+	worker_t *worker = arg;
+	trie_t *trie = worker->trie;
+	size_t size = MAX_COMPLETE;
+	char *complete = malloc(size);
+	DIE(!complete, "Malloc for completed word failed");
+
+	while (!__atomic_load_n(worker->stop, __ATOMIC_RELAXED)) {
+		char *word = stable[rand_r(&worker->seed) % STABLE_WORDS];
+
+		trie_read_begin(trie, worker->id);
+
+		unsigned int node = 0;
+		for (int i = 0; word[i]; i++) {
+			node = trie_child(trie, node, word[i] - 'a');
+			if (!node)
+				break;
+		}
+
+		trie_node_t *pool = TRIE_READ(trie->pool);
+		if (!node || !TRIE_READ(pool[node].end_of_word))
+			worker->missed++;
+
+		/**
+		 * The best completions of a prefix of the word, read from
+		 * the caches the writer keeps changing
+		 */
+		node = trie_child(trie, 0, word[0] - 'a');
+		complete[0] = word[0];
+		complete[1] = '\0';
+		complete_shortest(trie, node, &complete, &size);
+
+		complete[1] = '\0';
+		complete_frequent(trie, node, &complete, &size);
+
+		if (worker->stress) {
+			char prefix[3] = {word[0], word[1], '\0'};
+			for (int c = 1; c <= 3; c++)
+				autocomplete(trie, prefix, c, 3, print_word, NULL);
+			autocorrect(trie, word, 1, 1 + worker->ops % 2, print_word,
+						NULL);
+		}
+
+		trie_read_end(trie, worker->id);
+		worker->ops++;
+	}
+
+	free(complete);
+	return NULL;
+}
+
+static void *writer(void *arg)
+{
+	worker_t *worker = arg;
+	char *inserted = calloc(CHURN_WORDS, 1);
+	DIE(!inserted, "Calloc for churn state failed");
+
+	while (!__atomic_load_n(worker->stop, __ATOMIC_RELAXED)) {
+		int i = rand_r(&worker->seed) % CHURN_WORDS;
+
+		if (inserted[i])
+			trie_remove(worker->trie, churn[i]);
+		else
+			trie_insert(worker->trie, churn[i]);
+
+		inserted[i] = !inserted[i];
+		worker->ops++;
+	}
+
+	free(inserted);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	double seconds = argc > 1 ? atof(argv[1]) : 1;
+	int max_readers = argc > 2 ? atoi(argv[2]) : 32;
+	int stress = argc > 3 && !strcmp(argv[3], "stress");
+
+	if (max_readers > TRIE_READERS)
+		max_readers = TRIE_READERS;
+
+	unsigned int seed = 42;
+	for (int i = 0; i < STABLE_WORDS; i++)
+		random_word(stable[i], 2 + 2 * (rand_r(&seed) % 5), &seed);
+	for (int i = 0; i < CHURN_WORDS; i++)
+		random_word(churn[i], 1 + 2 * (rand_r(&seed) % 5), &seed);
+
+	/**
+	 * The words found by the searches that print aren't displayed
+	 */
+	if (stress && !freopen("/dev/null", "w", stdout))
+		return 1;
+
+	FILE *out = stress ? stderr : stdout;
+	long missed = 0;
+	fprintf(out, "readers  searches/s  writes/s\n");
+
+	for (int readers = 1; readers <= max_readers; readers *= 2) {
+		trie_t *trie = trie_create();
+		for (int i = 0; i < STABLE_WORDS; i++)
+			trie_insert(trie, stable[i]);
+
+		int stop = 0;
+		worker_t *workers = calloc(readers + 1, sizeof(worker_t));
+		DIE(!workers, "Calloc for workers failed");
+
+		for (int i = 0; i <= readers; i++) {
+			workers[i].trie = trie;
+			workers[i].id = i - 1;
+			workers[i].stress = stress;
+			workers[i].stop = &stop;
+			workers[i].seed = 1000 + i;
+			DIE(pthread_create(&workers[i].thread, NULL,
+							   i ? reader : writer, &workers[i]),
+				"Can't create a worker thread");
+		}
+
+		double start = stats_now();
+		struct timespec pause = {(time_t)seconds,
+								 (long)((seconds - (time_t)seconds) * 1e9)};
+		nanosleep(&pause, NULL);
+		__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+		long searches = 0;
+		for (int i = 0; i <= readers; i++) {
+			pthread_join(workers[i].thread, NULL);
+			if (i) {
+				searches += workers[i].ops;
+				missed += workers[i].missed;
+			}
+		}
+		double elapsed = stats_now() - start;
+
+		fprintf(out, "%7d  %10.0f  %8.0f\n", readers, searches / elapsed,
+				workers[0].ops / elapsed);
+
+		free(workers);
+		trie_free(&trie);
+	}
+
+	if (missed)
+		fprintf(stderr, "%ld searches missed a word\n", missed);
+
+	return missed ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../trie.h"
+#include "stats.h"
+
+/**
+ * Node visit rate of dfs_autocorrect() against the previous version of it,
+ * which called strlen() on the word being built at every child.
+ *
+ * Usage: bench_dfs [words] [word length]
+ */
+
+static long visits;
+
+static void print_word(const char *word, void *data)
+{
+	(void)data;
+	printf("%s\n", word);
+}
+
+/**
+ * The traversal as it was, counting the nodes visited
+ */
+static void dfs_strlen(trie_t *trie, unsigned int node, char *word,
+					   char *correct, int diff, int k, int *ok)
+{
+	visits++;
+
+	if (diff > k)
+		return;
+
+	if (!strcmp(word, "")) {
+		if (trie->pool[node].end_of_word) {
+			printf("%s\n", correct);
+			*ok = 1;
+		}
+		return;
+	}
+
+	for (unsigned int child = trie->pool[node].child; child;
+		 child = trie->pool[child].next) {
+		size_t len = strlen(correct);
+		correct[len] = trie->pool[child].letter;
+		correct[len + 1] = '\0';
+
+		dfs_strlen(trie, child, word + 1, correct,
+				   diff + (trie->pool[child].letter != *word), k, ok);
+
+		correct[strlen(correct) - 1] = '\0';
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : 200000;
+	int len = argc > 2 ? atoi(argv[2]) : 40;
+	int rounds = 20;
+
+	char *word = malloc(len + 1);
+	char *correct = malloc(len + 1);
+	DIE(!word || !correct, "Malloc for benchmark words failed");
+
+	srand(42);
+	trie_t *trie = trie_create();
+
+	/**
+	 * Long words of a few letters, sharing long prefixes
+	 */
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < len; j++)
+			word[j] = 'a' + rand() % 4;
+		word[len] = '\0';
+		trie_insert(trie, word);
+	}
+
+	/**
+	 * Every word of the length of the query is within k = len, so
+	 * the whole trie is visited. The words found are not displayed
+	 */
+	if (!freopen("/dev/null", "w", stdout))
+		return 1;
+
+	int ok = 0;
+	trie_output_t out = {print_word, NULL, 0};
+	double start = stats_now();
+	for (int r = 0; r < rounds; r++) {
+		correct[0] = '\0';
+		dfs_strlen(trie, 0, word, correct, 0, len, &ok);
+	}
+	double before = stats_now() - start;
+
+	start = stats_now();
+	for (int r = 0; r < rounds; r++)
+		dfs_autocorrect(trie, 0, word, correct, 0, 0, len, &out);
+	double after = stats_now() - start;
+
+	fprintf(stderr, "nodes %d, length %d, %ld visits\n", trie->nodes, len,
+			visits);
+	fprintf(stderr, "strlen     %8.1f M nodes/s\n", visits / before / 1e6);
+	fprintf(stderr, "depth      %8.1f M nodes/s  (x%.2f)\n",
+			visits / after / 1e6, before / after);
+
+	trie_free(&trie);
+	free(correct);
+	free(word);
+
+	return 0;
+}
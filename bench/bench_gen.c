@@ -0,0 +1,285 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../utils.h"
+
+/**
+ * Writes synthetic inputs and workloads on the standard output, the same
+ * ones for the same seed on every machine:
+ *
+ *   words <distinct> <count> [seed]
+ *       a dictionary for LOAD, count words of a Zipf distribution over
+ *       distinct words
+ *   mk <distinct> <commands> [seed] [dictionary]
+ *       INSERT, REMOVE, AUTOCOMPLETE and AUTOCORRECT commands for mk over
+ *       the words of the same distribution, after LOAD dictionary
+ *   points <uniform|clustered|sorted> <n> <k> [seed]
+ *       a points file for LOAD; the sorted points grow on the first axis,
+ *       the worst order for inserting them one by one
+ *   knn <points file> <commands> [seed]
+ *       LOAD of the file, then NN, KNN, RS, INSERT and DELETE commands for
+ *       kNN
+ *
+ * bench_replay_mk and bench_replay_knn run the workloads.
+ */
+
+#define GEN_RANGE 1000000 // coordinates are in [-GEN_RANGE, GEN_RANGE]
+#define GEN_CLUSTERS 16
+#define GEN_SPREAD 0.02 // standard deviation of a cluster, of the range
+#define GEN_PI 3.14159265358979323846
+
+static uint64_t next_random(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Uniform in [0, 1)
+ */
+static double next_double(uint64_t *state)
+{
+	return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int next_coord(uint64_t *state)
+{
+	return (int)(next_random(state) % (2 * GEN_RANGE + 1)) - GEN_RANGE;
+}
+
+/**
+ * The word of a rank, depending only on the seed
+ */
+static void rank_word(uint64_t seed, int rank, char *word)
+{
+	uint64_t state = seed * 0x100000001b3ULL + rank;
+	int len = 3 + next_random(&state) % 8;
+
+	for (int i = 0; i < len; i++)
+		word[i] = 'a' + next_random(&state) % 26;
+	word[len] = '\0';
+}
+
+/**
+ * The cumulative weights of the ranks, 1 / rank for Zipf's law
+ */
+static double *zipf_create(int distinct)
+{
+	double *weights = malloc(distinct * sizeof(double));
+	DIE(!weights, "Malloc for the Zipf weights failed");
+
+	double total = 0;
+	for (int i = 0; i < distinct; i++) {
+		total += 1.0 / (i + 1);
+		weights[i] = total;
+	}
+
+	return weights;
+}
+
+static int zipf_rank(double *weights, int distinct, uint64_t *state)
+{
+	double r = next_double(state) * weights[distinct - 1];
+	int lo = 0, hi = distinct - 1;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (weights[mid] < r)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void gen_words(int distinct, long count, uint64_t seed)
+{
+	double *weights = zipf_create(distinct);
+	uint64_t state = seed;
+	char word[16];
+
+	for (long i = 0; i < count; i++) {
+		rank_word(seed, zipf_rank(weights, distinct, &state), word);
+		printf("%s\n", word);
+	}
+
+	free(weights);
+}
+
+static void gen_mk(int distinct, long count, uint64_t seed, char *dictionary)
+{
+	double *weights = zipf_create(distinct);
+	uint64_t state = seed ^ 0x6d6b;
+	char word[16];
+
+	if (dictionary)
+		printf("LOAD %s\n", dictionary);
+
+	for (long i = 0; i < count; i++) {
+		int choice = next_random(&state) % 100;
+		rank_word(seed, zipf_rank(weights, distinct, &state), word);
+
+		if (choice < 35) {
+			printf("INSERT %s\n", word);
+		} else if (choice < 45) {
+			printf("REMOVE %s\n", word);
+		} else if (choice < 80) {
+			/**
+			 * A prefix of one to three letters, for one criterion or
+			 * for all of them
+			 */
+			word[1 + next_random(&state) % 3] = '\0';
+			printf("AUTOCOMPLETE %s %d\n", word,
+				   (int)(next_random(&state) % 4));
+		} else {
+			/**
+			 * A typo in the word
+			 */
+			word[next_random(&state) % strlen(word)] =
+				'a' + next_random(&state) % 26;
+			printf("AUTOCORRECT %s %d %d\n", word,
+				   1 + (int)(next_random(&state) % 2),
+				   (int)(next_random(&state) % 3));
+		}
+	}
+
+	printf("EXIT\n");
+	free(weights);
+}
+
+static void gen_points(char *kind, int n, int k, uint64_t seed)
+{
+	uint64_t state = seed;
+	int centers[GEN_CLUSTERS][k];
+
+	DIE(strcmp(kind, "uniform") && strcmp(kind, "clustered") &&
+		strcmp(kind, "sorted"), "Unknown distribution");
+
+	for (int c = 0; c < GEN_CLUSTERS; c++)
+		for (int j = 0; j < k; j++)
+			centers[c][j] = next_coord(&state);
+
+	printf("%d %d\n", n, k);
+	for (int i = 0; i < n; i++) {
+		int *center = centers[next_random(&state) % GEN_CLUSTERS];
+
+		for (int j = 0; j < k; j++) {
+			long long coord;
+
+			if (!strcmp(kind, "clustered")) {
+				/**
+				 * Box-Muller, a normal distribution around the center
+				 */
+				double u = 1 - next_double(&state);
+				double v = next_double(&state);
+				double normal = sqrt(-2 * log(u)) * cos(2 * GEN_PI * v);
+				coord = center[j] + llround(normal * GEN_SPREAD * GEN_RANGE);
+				if (coord < -GEN_RANGE)
+					coord = -GEN_RANGE;
+				if (coord > GEN_RANGE)
+					coord = GEN_RANGE;
+			} else if (!strcmp(kind, "sorted") && !j) {
+				coord = -GEN_RANGE + 2LL * GEN_RANGE * i / n;
+			} else {
+				coord = next_coord(&state);
+			}
+
+			printf("%lld ", coord);
+		}
+		printf("\n");
+	}
+}
+
+static void gen_knn(char *filename, long count, uint64_t seed)
+{
+	uint64_t state = seed ^ 0x6b6e6e;
+	int n, k;
+
+	FILE *in = fopen(filename, "rt");
+	DIE(!in, "Can't open the points file");
+	DIE(fscanf(in, "%d %d", &n, &k) != 2, "Invalid header");
+	fclose(in);
+
+	/**
+	 * The side of a range holding 8 points on average, were they uniform
+	 */
+	double side = 2.0 * GEN_RANGE * pow(8.0 / (n > 8 ? n : 8), 1.0 / k);
+	int *inserted = malloc((size_t)count * k * sizeof(int));
+	DIE(!inserted, "Malloc for the inserted points failed");
+	long inserts = 0;
+
+	printf("LOAD %s\n", filename);
+	for (long i = 0; i < count; i++) {
+		int choice = next_random(&state) % 100;
+
+		if (choice < 50) {
+			printf("NN");
+		} else if (choice < 65) {
+			printf("KNN 10");
+		} else if (choice < 80) {
+			printf("RS");
+			for (int j = 0; j < k; j++) {
+				int start = next_coord(&state);
+				printf(" %d %lld", start, (long long)start + (long long)side);
+			}
+			printf("\n");
+			continue;
+		} else if (choice < 90 || !inserts) {
+			int *point = inserted + inserts++ * k;
+			printf("INSERT");
+			for (int j = 0; j < k; j++) {
+				point[j] = next_coord(&state);
+				printf(" %d", point[j]);
+			}
+			printf("\n");
+			continue;
+		} else {
+			/**
+			 * One of the points inserted before
+			 */
+			int *point = inserted + (next_random(&state) % inserts) * k;
+			printf("DELETE");
+			for (int j = 0; j < k; j++)
+				printf(" %d", point[j]);
+			printf("\n");
+			continue;
+		}
+
+		for (int j = 0; j < k; j++)
+			printf(" %d", next_coord(&state));
+		printf("\n");
+	}
+
+	printf("EXIT\n");
+	free(inserted);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 3 && !strcmp(argv[1], "words")) {
+		gen_words(atoi(argv[2]), atol(argv[3]),
+				  argc > 4 ? strtoull(argv[4], NULL, 10) : 42);
+	} else if (argc > 3 && !strcmp(argv[1], "mk")) {
+		gen_mk(atoi(argv[2]), atol(argv[3]),
+			   argc > 4 ? strtoull(argv[4], NULL, 10) : 42,
+			   argc > 5 ? argv[5] : NULL);
+	} else if (argc > 4 && !strcmp(argv[1], "points")) {
+		gen_points(argv[2], atoi(argv[3]), atoi(argv[4]),
+				   argc > 5 ? strtoull(argv[5], NULL, 10) : 42);
+	} else if (argc > 3 && !strcmp(argv[1], "knn")) {
+		gen_knn(argv[2], atol(argv[3]),
+				argc > 4 ? strtoull(argv[4], NULL, 10) : 42);
+	} else {
+		fprintf(stderr, "Usage: bench_gen words|mk|points|knn ...\n");
+		return 1;
+	}
+
+	return 0;
+}
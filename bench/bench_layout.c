@@ -0,0 +1,127 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../bst.h"
+#include "../flat.h"
+#include "stats.h"
+
+/**
+ * Compares the pointer based k-d tree (node_t) with the flat one on
+ * memory and query time.
+ *
+ * Usage: bench_layout [points] [dimensions] [queries]
+ */
+
+/**
+ * Resident memory of the process in bytes, read from /proc
+ */
+static long resident(void)
+{
+	long pages = 0, rss = 0;
+	FILE *in = fopen("/proc/self/statm", "rt");
+	if (!in)
+		return 0;
+	if (fscanf(in, "%ld %ld", &pages, &rss) != 2)
+		rss = 0;
+	fclose(in);
+	return rss * 4096;
+}
+
+static void count_point(int *coord, int *k, void *data)
+{
+	(void)coord;
+	(void)k;
+	(*(long *)data)++;
+}
+
+int main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : 1000000;
+	int k = argc > 2 ? atoi(argv[2]) : 2;
+	int queries = argc > 3 ? atoi(argv[3]) : 200000;
+
+	srand(42);
+
+	int *points = malloc((size_t)n * k * sizeof(int));
+	int *targets = malloc((size_t)queries * k * sizeof(int));
+	DIE(!points || !targets, "Malloc for benchmark points failed");
+
+	for (size_t i = 0; i < (size_t)n * k; i++)
+		points[i] = rand() % 1000000;
+	for (size_t i = 0; i < (size_t)queries * k; i++)
+		targets[i] = rand() % 1000000;
+
+	long before = resident();
+	bst_t *bst = bst_create_tree();
+	bst_bulk_load(bst, points, n, &k);
+	long bst_bytes = resident() - before;
+
+	before = resident();
+	flat_t *flat = flat_create(bst, &k, 1);
+	long flat_bytes = resident() - before;
+
+	printf("points %d, dimensions %d\n", bst->size, k);
+	printf("memory   node_t %8.1f MB (%5.1f B/point)  flat %8.1f MB (%5.1f B/point)\n",
+		   bst_bytes / 1e6, (double)bst_bytes / bst->size,
+		   flat_bytes / 1e6, (double)flat_bytes / bst->size);
+
+	/**
+	 * Nearest neighbour queries
+	 */
+	double start = stats_now();
+	for (int q = 0; q < queries; q++)
+		nn(bst->root, targets + (size_t)q * k, &k, 0);
+	double bst_nn = stats_now() - start;
+
+	start = stats_now();
+	for (int q = 0; q < queries; q++)
+		flat_nn(flat, targets + (size_t)q * k);
+	double flat_nn_time = stats_now() - start;
+
+	printf("NN       node_t %8.0f q/s  flat %8.0f q/s  (x%.2f)\n",
+		   queries / bst_nn, queries / flat_nn_time, bst_nn / flat_nn_time);
+
+	/**
+	 * Range queries, boxes of 1% of the domain on every axis
+	 */
+	int *low = malloc(k * sizeof(int));
+	int *high = malloc(k * sizeof(int));
+	DIE(!low || !high, "Malloc for range failed");
+
+	long found_bst = 0, found_flat = 0;
+	int ranges = queries / 10;
+
+	start = stats_now();
+	for (int q = 0; q < ranges; q++) {
+		for (int i = 0; i < k; i++) {
+			low[i] = targets[(size_t)q * k + i];
+			high[i] = low[i] + 10000;
+		}
+		rs(bst->root, low, high, 0, &k, count_point, &found_bst);
+	}
+	double bst_rs = stats_now() - start;
+
+	start = stats_now();
+	for (int q = 0; q < ranges; q++) {
+		for (int i = 0; i < k; i++) {
+			low[i] = targets[(size_t)q * k + i];
+			high[i] = low[i] + 10000;
+		}
+		flat_rs(flat, low, high, count_point, &found_flat);
+	}
+	double flat_rs_time = stats_now() - start;
+
+	printf("RS       node_t %8.0f q/s  flat %8.0f q/s  (x%.2f), %ld/%ld points\n",
+		   ranges / bst_rs, ranges / flat_rs_time, bst_rs / flat_rs_time,
+		   found_bst, found_flat);
+
+	free(low);
+	free(high);
+	flat_free(flat);
+	bst_free_tree(bst);
+	free(targets);
+	free(points);
+
+	return 0;
+}
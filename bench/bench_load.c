@@ -0,0 +1,113 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../trie.h"
+#include "stats.h"
+
+/**
+ * Writes a corpus of Zipf distributed words and measures the throughput of
+ * trie_load_file() against the previous fscanf("%s") loop, then the time
+ * to open a snapshot of the same trie.
+ *
+ * Usage: bench_load [megabytes] [distinct words] [file]
+ */
+
+int main(int argc, char **argv)
+{
+	long megabytes = argc > 1 ? atol(argv[1]) : 256;
+	int distinct = argc > 2 ? atoi(argv[2]) : 500000;
+	char *filename = argc > 3 ? argv[3] : "/tmp/bench_load.txt";
+
+	srand(42);
+
+	/**
+	 * The dictionary and the cumulative Zipf weights of its words
+	 */
+	char **words = malloc(distinct * sizeof(char *));
+	double *weights = malloc(distinct * sizeof(double));
+	DIE(!words || !weights, "Malloc for dictionary failed");
+
+	double total = 0;
+	for (int i = 0; i < distinct; i++) {
+		int len = 2 + rand() % 12;
+		words[i] = malloc(len + 1);
+		DIE(!words[i], "Malloc for word failed");
+
+		for (int j = 0; j < len; j++)
+			words[i][j] = 'a' + rand() % ALPHABET_SIZE;
+		words[i][len] = '\0';
+
+		total += 1.0 / (i + 1);
+		weights[i] = total;
+	}
+
+	FILE *out = fopen(filename, "wt");
+	DIE(!out, "Can't create the corpus");
+
+	long bytes = 0;
+	while (bytes < megabytes * 1000000) {
+		double r = (double)rand() / RAND_MAX * total;
+		int lo = 0, hi = distinct - 1;
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (weights[mid] < r)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		bytes += fprintf(out, "%s\n", words[lo]);
+	}
+	fclose(out);
+
+	/**
+	 * The previous loader, with the repeated last word fixed
+	 */
+	trie_t *trie = trie_create();
+	char word[MAX_COMPLETE];
+
+	double start = stats_now();
+	FILE *in = fopen(filename, "rt");
+	DIE(!in, "Can't open the corpus");
+	while (fscanf(in, "%49s", word) == 1)
+		trie_insert(trie, word);
+	fclose(in);
+	double before = stats_now() - start;
+	int size = trie->size;
+	trie_free(&trie);
+
+	trie = trie_create();
+	start = stats_now();
+	trie_load_file(trie, filename);
+	double after = stats_now() - start;
+
+	char snapshot[256];
+	snprintf(snapshot, sizeof(snapshot), "%s.trie", filename);
+	trie_save(trie, snapshot);
+
+	start = stats_now();
+	trie_t *opened = trie_open(snapshot);
+	unsigned int node = trie_child(opened, 0, 0);
+	node = node ? trie_child(opened, node, 1) : 0;
+	double open_time = stats_now() - start;
+	trie_free(&opened);
+	remove(snapshot);
+
+	printf("corpus %.0f MB, %d distinct words (%d loaded)\n", bytes / 1e6,
+		   size, trie->size);
+	printf("fscanf         %7.1f MB/s\n", bytes / before / 1e6);
+	printf("trie_load_file %7.1f MB/s  (x%.2f)\n", bytes / after / 1e6,
+		   before / after);
+	printf("LOAD %.3f s, OPEN and first lookup %.6f s (%s)\n", after,
+		   open_time, node ? "found" : "missing");
+
+	trie_free(&trie);
+	for (int i = 0; i < distinct; i++)
+		free(words[i]);
+	free(words);
+	free(weights);
+	remove(filename);
+
+	return 0;
+}
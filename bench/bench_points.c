@@ -0,0 +1,95 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bst.h"
+#include "../flat.h"
+#include "stats.h"
+
+/**
+ * Writes a file of random points and measures reading it with read_points()
+ * against the previous fscanf("%d") loop, and the whole LOAD with the bulk
+ * build of the tree, then opening a snapshot of the same tree.
+ *
+ * Usage: bench_points [points] [dimensions] [file]
+ */
+
+int main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : 10000000;
+	int k = argc > 2 ? atoi(argv[2]) : 3;
+	char *filename = argc > 3 ? argv[3] : "/tmp/bench_points.txt";
+
+	srand(42);
+
+	FILE *out = fopen(filename, "wt");
+	DIE(!out, "Can't create the points file");
+
+	long bytes = fprintf(out, "%d %d\n", n, k);
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < k; j++)
+			bytes += fprintf(out, "%d ", rand() % 2000001 - 1000000);
+		bytes += fprintf(out, "\n");
+	}
+	fclose(out);
+
+	/**
+	 * The previous parser
+	 */
+	double start = stats_now();
+	FILE *in = fopen(filename, "rt");
+	DIE(!in, "Can't open the points file");
+
+	int size, dimensions;
+	DIE(fscanf(in, "%d %d", &size, &dimensions) != 2, "Invalid header");
+	int *before = malloc((size_t)size * dimensions * sizeof(int));
+	DIE(!before, "Malloc for points failed");
+	for (size_t i = 0; i < (size_t)size * dimensions; i++)
+		DIE(fscanf(in, "%d", &before[i]) != 1, "Invalid point");
+	fclose(in);
+	double old_time = stats_now() - start;
+
+	start = stats_now();
+	int *after = read_points(filename, &size, &dimensions);
+	double new_time = stats_now() - start;
+
+	DIE(memcmp(before, after, (size_t)size * dimensions * sizeof(int)),
+		"The parsers disagree");
+
+	bst_t *bst = bst_create_tree();
+	start = stats_now();
+	bst_bulk_load(bst, after, size, &dimensions);
+	double build_time = stats_now() - start;
+
+	char snapshot[256];
+	snprintf(snapshot, sizeof(snapshot), "%s.kd", filename);
+	flat_t *flat = flat_create(bst, &dimensions, FLAT_BUCKET);
+	flat_save(flat, snapshot);
+	flat_free(flat);
+
+	start = stats_now();
+	flat = flat_open(snapshot);
+	int *nearest = flat_nn(flat, after);
+	double open_time = stats_now() - start;
+	DIE(!nearest, "Empty snapshot");
+	flat_free(flat);
+	remove(snapshot);
+
+	printf("file %.0f MB, %d points of %d dimensions\n", bytes / 1e6, n, k);
+	printf("fscanf      %7.3f s  %7.1f MB/s\n", old_time,
+		   bytes / old_time / 1e6);
+	printf("read_points %7.3f s  %7.1f MB/s  (x%.1f)\n", new_time,
+		   bytes / new_time / 1e6, old_time / new_time);
+	printf("bulk load   %7.3f s\n", build_time);
+	printf("LOAD        %7.3f s -> %7.3f s\n", old_time + build_time,
+		   new_time + build_time);
+	printf("OPEN + NN   %7.6f s\n", open_time);
+
+	bst_free_tree(bst);
+	free(before);
+	free(after);
+	remove(filename);
+
+	return 0;
+}
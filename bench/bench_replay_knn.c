@@ -0,0 +1,112 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../bst.h"
+#include "stats.h"
+
+/**
+ * Replays a file of kNN commands (see bench_gen knn) and prints the
+ * throughput and the latency percentiles of every command, one JSON object
+ * per line. Only the call doing the command is timed, not the parsing;
+ * the points found are counted instead of printed.
+ *
+ * Usage: bench_replay_knn <commands> [workload name]
+ */
+
+#define REPLAY_KNN 64
+
+static void count_point(int *coord, int *k, void *data)
+{
+	(void)coord;
+	(void)k;
+	(*(long *)data)++;
+}
+
+/**
+ * Reads the integers after the command
+ */
+static int read_numbers(char *line, int *numbers, int max)
+{
+	char *end;
+	int count = 0;
+
+	while (count < max) {
+		long value = strtol(line, &end, 10);
+		if (end == line)
+			break;
+		numbers[count++] = (int)value;
+		line = end;
+	}
+
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	DIE(argc < 2, "Usage: bench_replay_knn <commands> [workload name]");
+
+	FILE *in = fopen(argv[1], "rt");
+	DIE(!in, "Can't open the commands");
+
+	FILE *report = stats_silence();
+	stats_t stats = {0};
+	bst_t *bst = bst_create_tree();
+	int *neighbours[REPLAY_KNN];
+	int k = 0, numbers[2 * 1024 + 1];
+	long found = 0;
+
+	char *line = NULL, command[16], filename[256];
+	size_t size = 0;
+
+	while (getline(&line, &size, in) != -1) {
+		int skip = 0;
+		if (sscanf(line, "%15s%n", command, &skip) < 1)
+			continue;
+
+		int count = read_numbers(line + skip, numbers, 2 * 1024 + 1);
+		double start = stats_now();
+
+		if (!strcmp(command, "LOAD")) {
+			DIE(sscanf(line + skip, "%255s", filename) != 1, "No file");
+			start = stats_now();
+			bst_load_file(bst, filename, &k);
+		} else if (!strcmp(command, "NN") && count == k) {
+			found += !!nn(bst->root, numbers, &k, 0);
+		} else if (!strcmp(command, "KNN") && count == k + 1) {
+			int n = numbers[0] < REPLAY_KNN ? numbers[0] : REPLAY_KNN;
+			found += knn(bst->root, numbers + 1, n, &k, neighbours);
+		} else if (!strcmp(command, "RS") && count == 2 * k) {
+			int start_range[k], end_range[k];
+			for (int i = 0; i < k; i++) {
+				start_range[i] = numbers[2 * i];
+				end_range[i] = numbers[2 * i + 1];
+			}
+			start = stats_now();
+			rs(bst->root, start_range, end_range, 0, &k, count_point, &found);
+		} else if (!strcmp(command, "INSERT") && count == k) {
+			bst_insert_node(bst, numbers, &k);
+		} else if (!strcmp(command, "DELETE") && count == k) {
+			bst_delete_node(bst, numbers, &k);
+		} else {
+			break;
+		}
+
+		stats_add(&stats, command, stats_now() - start);
+	}
+
+	/**
+	 * Keeps the searches from being optimized away
+	 */
+	printf("%ld\n", found);
+	stats_report(&stats, argc > 2 ? argv[2] : "knn", report);
+
+	stats_free(&stats);
+	bst_free_tree(bst);
+	free(line);
+	fclose(in);
+	fclose(report);
+
+	return 0;
+}
@@ -0,0 +1,74 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../trie.h"
+#include "stats.h"
+
+/**
+ * Replays a file of mk commands (see bench_gen mk) and prints the
+ * throughput and the latency percentiles of every command, one JSON object
+ * per line. Only the call doing the command is timed, not the parsing;
+ * the words the commands display are discarded.
+ *
+ * Usage: bench_replay_mk <commands> [workload name]
+ */
+
+static void print_word(const char *word, void *data)
+{
+	(void)data;
+	printf("%s\n", word);
+}
+
+int main(int argc, char **argv)
+{
+	DIE(argc < 2, "Usage: bench_replay_mk <commands> [workload name]");
+
+	FILE *in = fopen(argv[1], "rt");
+	DIE(!in, "Can't open the commands");
+
+	FILE *report = stats_silence();
+	stats_t stats = {0};
+	trie_t *trie = trie_create();
+
+	char *line = NULL, command[16], word[256];
+	size_t size = 0;
+
+	while (getline(&line, &size, in) != -1) {
+		int a = 0, b = -1;
+		if (sscanf(line, "%15s %255s %d %d", command, word, &a, &b) < 1)
+			continue;
+
+		double start = stats_now();
+
+		if (!strcmp(command, "INSERT"))
+			trie_insert(trie, word);
+		else if (!strcmp(command, "REMOVE"))
+			trie_remove(trie, word);
+		else if (!strcmp(command, "LOAD"))
+			trie_load_file(trie, word);
+		else if (!strcmp(command, "AUTOCORRECT"))
+			autocorrect(trie, word, a, b < 0 ? 0 : b, print_word, NULL);
+		else if (!strcmp(command, "AUTOCOMPLETE")) {
+			for (int c = 1; c <= 3; c++) {
+				if (a == c || !a)
+					autocomplete(trie, word, c, b < 0 ? 1 : b, print_word,
+								 NULL);
+			}
+		} else
+			break;
+
+		stats_add(&stats, command, stats_now() - start);
+	}
+
+	stats_report(&stats, argc > 2 ? argv[2] : "mk", report);
+
+	stats_free(&stats);
+	trie_free(&trie);
+	free(line);
+	fclose(in);
+	fclose(report);
+
+	return 0;
+}
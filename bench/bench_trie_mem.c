@@ -0,0 +1,68 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../trie.h"
+#include "stats.h"
+
+/**
+ * Inserts random words in a trie and compares the memory of the pool of
+ * compact nodes with the one the previous layout needed: a 24 byte node
+ * and a calloc'd array of 26 children pointers for every node.
+ *
+ * Usage: bench_trie_mem [words] [max length]
+ */
+
+/**
+ * Size of the chunk glibc malloc uses for a request of the given size
+ */
+static size_t chunk(size_t size)
+{
+	size_t total = (size + 8 + 15) & ~(size_t)15;
+	return total < 32 ? 32 : total;
+}
+
+int main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : 1000000;
+	int max_len = argc > 2 ? atoi(argv[2]) : 12;
+	char word[MAX_COMPLETE];
+
+	if (max_len >= MAX_COMPLETE)
+		max_len = MAX_COMPLETE - 1;
+
+	srand(42);
+	trie_t *trie = trie_create();
+
+	double start = stats_now();
+	for (int i = 0; i < n; i++) {
+		/**
+		 * Skewed letters give the shared prefixes of a real dictionary
+		 */
+		int len = 3 + rand() % (max_len - 2);
+		for (int j = 0; j < len; j++) {
+			int r = rand() % 100;
+			word[j] = 'a' + (r * r) / 400;
+		}
+		word[len] = '\0';
+		trie_insert(trie, word);
+	}
+	double elapsed = stats_now() - start;
+
+	size_t legacy_node = 3 * sizeof(int) + sizeof(void *);
+	size_t legacy = (size_t)trie->nodes *
+					(chunk(legacy_node) + chunk(26 * sizeof(void *)));
+	size_t pool = (size_t)trie->capacity * sizeof(trie_node_t);
+
+	printf("words %d, distinct %d, nodes %d, insert %.0f words/s\n",
+		   n, trie->size, trie->nodes, n / elapsed);
+	printf("legacy  %8.1f MB (%zu B/node)\n", legacy / 1e6,
+		   legacy / trie->nodes);
+	printf("compact %8.1f MB (%zu B/node, pool of %u slots)  x%.1f smaller\n",
+		   pool / 1e6, sizeof(trie_node_t), trie->capacity,
+		   (double)legacy / pool);
+
+	trie_free(&trie);
+
+	return 0;
+}
@@ -0,0 +1,118 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "../utils.h"
+
+double stats_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void stats_add(stats_t *stats, const char *name, double latency)
+{
+	int i = 0;
+	while (i < stats->commands && strcmp(stats->command[i].name, name))
+		i++;
+
+	stats_command_t *command = &stats->command[i];
+	if (i == stats->commands) {
+		DIE(i == STATS_COMMANDS, "Too many commands");
+		snprintf(command->name, STATS_NAME, "%s", name);
+		stats->commands++;
+	}
+
+	if (command->count == command->capacity) {
+		command->capacity = command->capacity ? 2 * command->capacity : 1024;
+		command->latency = realloc(command->latency,
+								   command->capacity * sizeof(double));
+		DIE(!command->latency, "Realloc for latencies failed");
+	}
+
+	command->latency[command->count++] = latency;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * The smallest latency having at least a fraction p of them under or equal
+ * to it, from a sorted array
+ */
+static double percentile(double *latency, long count, double p)
+{
+	long i = (long)(p * count + 0.999999) - 1;
+	if (i < 0)
+		i = 0;
+	return latency[i];
+}
+
+static void report_line(const char *workload, const char *name,
+						double *latency, long count, FILE *out)
+{
+	double total = 0;
+	for (long i = 0; i < count; i++)
+		total += latency[i];
+
+	qsort(latency, count, sizeof(double), compare_latency);
+
+	fprintf(out, "{\"workload\": \"%s\", \"command\": \"%s\", "
+			"\"count\": %ld, \"seconds\": %.6f, \"ops_per_s\": %.1f, "
+			"\"p50_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f}\n",
+			workload, name, count, total, total > 0 ? count / total : 0,
+			percentile(latency, count, 0.5) * 1e6,
+			percentile(latency, count, 0.99) * 1e6,
+			percentile(latency, count, 0.999) * 1e6);
+}
+
+void stats_report(stats_t *stats, const char *workload, FILE *out)
+{
+	long count = 0;
+	for (int i = 0; i < stats->commands; i++)
+		count += stats->command[i].count;
+	if (!count)
+		return;
+
+	double *all = malloc(count * sizeof(double));
+	DIE(!all, "Malloc for latencies failed");
+
+	count = 0;
+	for (int i = 0; i < stats->commands; i++) {
+		stats_command_t *command = &stats->command[i];
+		memcpy(all + count, command->latency, command->count * sizeof(double));
+		count += command->count;
+
+		report_line(workload, command->name, command->latency,
+					command->count, out);
+	}
+
+	report_line(workload, "total", all, count, out);
+	fflush(out);
+	free(all);
+}
+
+void stats_free(stats_t *stats)
+{
+	for (int i = 0; i < stats->commands; i++)
+		free(stats->command[i].latency);
+	stats->commands = 0;
+}
+
+FILE *stats_silence(void)
+{
+	fflush(stdout);
+
+	FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+	DIE(!out, "Can't duplicate the standard output");
+	DIE(!freopen("/dev/null", "w", stdout), "Can't open /dev/null");
+
+	return out;
+}
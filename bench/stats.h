@@ -0,0 +1,72 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdio.h>
+
+#define STATS_COMMANDS 16
+#define STATS_NAME 16
+
+/**
+ * The latencies of one command, in seconds
+ */
+typedef struct stats_command_t stats_command_t;
+struct stats_command_t {
+	char name[STATS_NAME];
+	double *latency;
+	long count;
+	long capacity;
+};
+
+typedef struct stats_t stats_t;
+struct stats_t {
+	stats_command_t command[STATS_COMMANDS];
+	int commands;
+};
+
+/**
+ * @brief The function returns the time of a monotonic clock, in seconds.
+ * 
+ * @return double 
+ */
+double stats_now(void);
+
+/**
+ * @brief The function records the latency of a command, adding the
+ * command the first time its name is seen.
+ * 
+ * @param stats the latencies
+ * @param name the command
+ * @param latency its duration, in seconds
+ */
+void stats_add(stats_t *stats, const char *name, double latency);
+
+/**
+ * @brief The function prints one JSON object per line for every command:
+ * the workload, the command, how many ran, their total time, the
+ * throughput and the 50th, 99th and 99.9th percentiles of the latency in
+ * microseconds. A last line named "total" covers all of them.
+ * 
+ * @param stats the latencies
+ * @param workload the name of the workload
+ * @param out where to print
+ */
+void stats_report(stats_t *stats, const char *workload, FILE *out);
+
+/**
+ * @brief The function frees the latencies.
+ * 
+ * @param stats the latencies
+ */
+void stats_free(stats_t *stats);
+
+/**
+ * @brief The function redirects the standard output to /dev/null, so the
+ * results of the replayed commands aren't printed, and returns a stream
+ * writing to the previous standard output, for the report.
+ * 
+ * @return FILE* 
+ */
+FILE *stats_silence(void);
+
+#endif /* STATS_H_ */
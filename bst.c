@@ -1,25 +1,32 @@
 /* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "bst.h"
+#include "counters.h"
 
-node_t *bst_create_node(int *point, int *k)
+node_t *bst_create_node(bst_t *bst, int *point, int *k)
 {
 	/**
-	 * Allocates space defensively for the node
-	 * and assigns each field of the stucture
+	 * The size of the nodes is known once the dimensions are,
+	 * so the arena is prepared for the first node
 	 */
-	node_t *node = malloc(sizeof(node_t));
-	DIE(!node, "Malloc for node allocation failed");
+	if (!bst->arena.object_size)
+		arena_init(&bst->arena, sizeof(node_t) + *k * sizeof(int));
+
+	node_t *node = arena_alloc(&bst->arena);
 
 	node->left = NULL;
 	node->right = NULL;
-
-	node->coord = malloc(*k * sizeof(int));
-	DIE(!node->coord, "Malloc for node coordinates failed");
+	node->size = 1;
 
 	memcpy(node->coord, point, *k * sizeof(int));
 
@@ -37,171 +44,895 @@ bst_t *bst_create_tree(void)
 
 	bst->root = NULL;
 	bst->size = 0;
+	bst->max_size = 0;
+	bst->arena.object_size = 0;
+	bst->arena.blocks = NULL;
 
 	return bst;
 }
 
+/**
+ * The depth a tree of n points may reach before a subtree is rebuilt:
+ * log of n in base 1 / BST_ALPHA
+ */
+static int alpha_depth(int n)
+{
+	int depth = 0;
+	for (double size = 1; size * (1 / BST_ALPHA) <= n; size /= BST_ALPHA)
+		depth++;
+	return depth;
+}
+
+void collect_points(node_t *node, int *points, int *pos, int *k)
+{
+	if (!node)
+		return;
+
+	collect_points(node->left, points, pos, k);
+	memcpy(points + (size_t)*pos * *k, node->coord, *k * sizeof(int));
+	(*pos)++;
+	collect_points(node->right, points, pos, k);
+}
+
+/**
+ * Rebuilds the subtree balanced, its root being at the given depth, and
+ * returns its new root
+ */
+static node_t *rebuild(bst_t *bst, node_t *node, int depth, int *k)
+{
+	int n = 0;
+	int *points = malloc((size_t)node->size * *k * sizeof(int));
+	DIE(!points, "Malloc for rebuilt points failed");
+
+	collect_points(node, points, &n, k);
+	bst_free_subtree(bst, node);
+
+	node = bst_build(bst, points, n, depth, k);
+	free(points);
+
+	return node;
+}
+
+/**
+ * Searches the point in the subtree. Points equal to a node on its axis
+ * may be on both sides of it, so both are searched then
+ */
+static int contains(node_t *node, int *point, int depth, int *k)
+{
+	while (node) {
+		if (!memcmp(point, node->coord, *k * sizeof(int)))
+			return 1;
+
+		int axis = depth % *k;
+		if (point[axis] == node->coord[axis] &&
+			contains(node->left, point, depth + 1, k))
+			return 1;
+
+		node = point[axis] >= node->coord[axis] ? node->right : node->left;
+		depth++;
+	}
+
+	return 0;
+}
+
 void bst_insert_node(bst_t *bst, int *point, int *k)
 {
-	node_t *root = bst->root;
-	node_t *parent = root;
-	node_t *node = bst_create_node(point, k);
+	node_t *path[BST_MAX_DEPTH];
+	node_t *parent = bst->root, *leaf;
+	int level = 0;
 
 	if (!parent) {
-		bst->root = node;
+		bst->root = bst_create_node(bst, point, k);
+		bst->size = bst->max_size = 1;
 		return;
 	}
 
-	int level = 0;
+	/**
+	 * If a point with identical coordinates as an existing
+	 * point wants to be inserted, continues
+	 */
+	if (contains(parent, point, 0, k))
+		return;
 
 	while (1) {
-		if (point[level % *k] >= parent->coord[level % *k]) {
-			/**
-			 * If a point with identical coordinates as an existing
-			 * point wants to be inserted, continues
-			 */
-			if (point[level % *k] == parent->coord[level % *k]) {
-				for (int i = 0; i < *k && i != level % *k; i++) {
-					if (point[i] != parent->coord[i])
-						break;
-				}
-				free(node->coord);
-				free(node);
-				break;
-			}
+		path[level] = parent;
+		node_t **next = point[level % *k] >= parent->coord[level % *k] ?
+						&parent->right : &parent->left;
+		level++;
+
+		if (!*next) {
+			leaf = *next = bst_create_node(bst, point, k);
+			break;
+		}
+		parent = *next;
+	}
 
-			if (!parent->right) {
-				parent->right = node;
-				bst->size++;
-				break;
-			}
-			parent = parent->right;
-			level++;
+	for (int i = 0; i < level; i++)
+		path[i]->size++;
+
+	bst->size++;
+	if (bst->size > bst->max_size)
+		bst->max_size = bst->size;
+
+	/**
+	 * A leaf too deep for the size of the tree has an ancestor with a
+	 * child holding more than BST_ALPHA of its points (a scapegoat). The
+	 * lowest one is rebuilt balanced, which brings the depth back
+	 */
+	if (level <= alpha_depth(bst->size))
+		return;
+
+	for (int i = level - 1; i >= 0; i--) {
+		node_t *child = i + 1 < level ? path[i + 1] : leaf;
+		if (child->size <= BST_ALPHA * path[i]->size)
 			continue;
 
+		if (!i) {
+			bst->root = rebuild(bst, path[0], 0, k);
+		} else if (path[i - 1]->left == path[i]) {
+			path[i - 1]->left = rebuild(bst, path[i], i, k);
 		} else {
-			if (!parent->left) {
-				parent->left = node;
-				bst->size++;
-				break;
+			path[i - 1]->right = rebuild(bst, path[i], i, k);
+		}
+		return;
+	}
+}
+
+/**
+ * Lexicographic comparison of two points
+ */
+static int compare_points(int *a, int *b, int k)
+{
+	for (int d = 0; d < k; d++) {
+		if (a[d] != b[d])
+			return a[d] < b[d] ? -1 : 1;
+	}
+	return 0;
+}
+
+/**
+ * Merge sort of the points [lo, hi) of the array, moving the coordinates
+ * themselves so every pass reads and writes them in order
+ */
+static void sort_points(int *points, int *aux, int lo, int hi, int k)
+{
+	if (hi - lo < 2)
+		return;
+
+	int mid = lo + (hi - lo) / 2;
+	sort_points(points, aux, lo, mid, k);
+	sort_points(points, aux, mid, hi, k);
+
+	size_t row = k * sizeof(int);
+	int *left = points + (size_t)lo * k, *left_end = points + (size_t)mid * k;
+	int *right = left_end, *right_end = points + (size_t)hi * k;
+	int *pos = aux + (size_t)lo * k;
+
+	while (left < left_end && right < right_end) {
+		if (compare_points(right, left, k) < 0) {
+			memcpy(pos, right, row);
+			right += k;
+		} else {
+			memcpy(pos, left, row);
+			left += k;
+		}
+		pos += k;
+	}
+	memcpy(pos, left, (left_end - left) * sizeof(int));
+	pos += left_end - left;
+	memcpy(pos, right, (right_end - right) * sizeof(int));
+
+	memcpy(points + (size_t)lo * k, aux + (size_t)lo * k, (hi - lo) * row);
+}
+
+static void swap_points(int *a, int *b, int k)
+{
+	for (int i = 0; i < k; i++) {
+		int aux = a[i];
+		a[i] = b[i];
+		b[i] = aux;
+	}
+}
+
+void select_median(int *points, int n, int mid, int axis, int k)
+{
+	int lo = 0, hi = n - 1;
+
+	while (lo < hi) {
+		int pivot = points[(size_t)(lo + (hi - lo) / 2) * k + axis];
+		int i = lo, j = hi;
+
+		while (i <= j) {
+			while (points[(size_t)i * k + axis] < pivot)
+				i++;
+			while (points[(size_t)j * k + axis] > pivot)
+				j--;
+
+			if (i <= j) {
+				swap_points(points + (size_t)i * k, points + (size_t)j * k,
+							k);
+				i++;
+				j--;
 			}
-			parent = parent->left;
-			level++;
-			continue;
 		}
+
+		if (mid <= j)
+			hi = j;
+		else if (mid >= i)
+			lo = i;
+		else
+			break;
+	}
+}
+
+node_t *bst_build(bst_t *bst, int *points, int n, int depth, int *k)
+{
+	if (n <= 0)
+		return NULL;
+
+	/**
+	 * The median on the splitting coordinate becomes the root, so
+	 * every level halves the number of points. The nodes are created
+	 * in preorder, so a subtree lies in a contiguous part of the arena
+	 */
+	int mid = n / 2;
+	select_median(points, n, mid, depth % *k, *k);
+
+	node_t *root = bst_create_node(bst, points + (size_t)mid * *k, k);
+	root->left = bst_build(bst, points, mid, depth + 1, k);
+	root->right = bst_build(bst, points + (size_t)(mid + 1) * *k,
+							n - mid - 1, depth + 1, k);
+	root->size = n;
+
+	return root;
+}
+
+void bst_bulk_load(bst_t *bst, int *points, int n, int *k)
+{
+	if (n <= 0)
+		return;
+
+	size_t row = *k * sizeof(int);
+
+	int *copy = malloc(n * row);
+	DIE(!copy, "Malloc for copy of points failed");
+
+	int *aux = malloc(n * row);
+	DIE(!aux, "Malloc for auxiliary points failed");
+
+	/**
+	 * Sorting the points brings the identical ones next to each other,
+	 * so only the first of them is kept
+	 */
+	memcpy(copy, points, n * row);
+	sort_points(copy, aux, 0, n, *k);
+	free(aux);
+
+	int unique = 1;
+	for (int i = 1; i < n; i++) {
+		int *point = copy + (size_t)i * *k;
+		if (!memcmp(point, copy + (size_t)(unique - 1) * *k, row))
+			continue;
+
+		memcpy(copy + (size_t)unique++ * *k, point, row);
 	}
+
+	bst->root = bst_build(bst, copy, unique, 0, k);
+	bst->size = bst->max_size = unique;
+
+	free(copy);
 }
 
-void bst_free_subtree(node_t *node)
+void bst_free_subtree(bst_t *bst, node_t *node)
 {
 	if (!node)
 		return;
 
-	bst_free_subtree(node->left);
-	bst_free_subtree(node->right);
+	bst_free_subtree(bst, node->left);
+	bst_free_subtree(bst, node->right);
 
-	free(node->coord);
-	free(node);
+	arena_release(&bst->arena, node);
+}
+
+/**
+ * The node of the subtree with the smallest coordinate on the axis
+ */
+static node_t *find_min(node_t *node, int axis, int depth, int *k)
+{
+	if (!node)
+		return NULL;
+
+	/**
+	 * On its own axis the node is less or equal to its right subtree,
+	 * so only the left one can hold a smaller coordinate
+	 */
+	node_t *min = find_min(node->left, axis, depth + 1, k);
+	if (depth % *k != axis) {
+		node_t *right = find_min(node->right, axis, depth + 1, k);
+		if (right && (!min || right->coord[axis] < min->coord[axis]))
+			min = right;
+	}
+
+	if (!min || node->coord[axis] <= min->coord[axis])
+		min = node;
+	return min;
+}
+
+/**
+ * Removes the point from the subtree and returns its new root, setting
+ * deleted if the point was found
+ */
+static node_t *delete_point(bst_t *bst, node_t *node, int *point, int depth,
+							int *k, int *deleted)
+{
+	if (!node)
+		return NULL;
+
+	int axis = depth % *k;
+
+	if (!memcmp(point, node->coord, *k * sizeof(int))) {
+		*deleted = 1;
+
+		/**
+		 * The node takes the point with the smallest coordinate on its
+		 * axis from its right subtree, which is then deleted from there.
+		 * Without a right subtree, the left one becomes the right one:
+		 * its minimum is less or equal to all of its points
+		 */
+		node_t *from = node->right ? node->right : node->left;
+		if (!from) {
+			arena_release(&bst->arena, node);
+			return NULL;
+		}
+
+		node_t *min = find_min(from, axis, depth + 1, k);
+		memcpy(node->coord, min->coord, *k * sizeof(int));
+
+		int removed = 0;
+		node->right = delete_point(bst, from, node->coord, depth + 1, k,
+								   &removed);
+		if (from == node->left)
+			node->left = NULL;
+
+		node->size--;
+		return node;
+	}
+
+	/**
+	 * Points equal to the node on its axis may be on both sides
+	 */
+	if (point[axis] <= node->coord[axis])
+		node->left = delete_point(bst, node->left, point, depth + 1, k,
+								  deleted);
+	if (!*deleted && point[axis] >= node->coord[axis])
+		node->right = delete_point(bst, node->right, point, depth + 1, k,
+								   deleted);
+
+	if (*deleted)
+		node->size--;
+	return node;
+}
+
+int bst_delete_node(bst_t *bst, int *point, int *k)
+{
+	int deleted = 0;
+	bst->root = delete_point(bst, bst->root, point, 0, k, &deleted);
+	if (!deleted)
+		return 0;
+
+	bst->size--;
+
+	/**
+	 * Deletions don't make the tree deeper, but once it holds less than
+	 * BST_ALPHA of the most points it had the depth bound is too loose,
+	 * so the whole tree is rebuilt
+	 */
+	if (bst->root && bst->size < BST_ALPHA * bst->max_size) {
+		bst->root = rebuild(bst, bst->root, 0, k);
+		bst->max_size = bst->size;
+	}
+
+	return 1;
+}
+
+int bst_depth(node_t *node)
+{
+	if (!node)
+		return 0;
+
+	int left = bst_depth(node->left), right = bst_depth(node->right);
+	return 1 + (left > right ? left : right);
 }
 
 void bst_free_tree(bst_t *bst)
 {
 	/**
-	 * The function frees all the nodes starting with the root
-	 * and after it the bst structure
+	 * All the nodes are in the arena, so they are freed together
+	 * without walking the tree, and after them the bst structure
 	 */
-	bst_free_subtree(bst->root);
+	if (bst->arena.object_size)
+		arena_destroy(&bst->arena);
 	free(bst);
 }
 
-void load_file(bst_t *bst, char *filename, int *k)
+/**
+ * State of the integers parsed from a file of points: its header and then
+ * the coordinates, in the order they were read
+ */
+typedef struct point_reader_t point_reader_t;
+struct point_reader_t {
+	int header[2]; // number of points and dimensions
+	int values; // how many values of the header were read
+	int *points; // n * k coordinates
+	size_t count; // coordinates read
+	size_t total; // coordinates expected
+};
+
+static void reader_push(point_reader_t *reader, int value)
 {
-	FILE *in = fopen(filename, "rt");
-	DIE(!in, "Can't open the ascii file");
+	if (reader->values < 2) {
+		reader->header[reader->values++] = value;
+
+		/**
+		 * The whole array is allocated once the header is known
+		 */
+		if (reader->values == 2) {
+			INVALID(reader->header[0] < 0 || reader->header[1] <= 0,
+				"Invalid header of the ascii file");
+
+			reader->total = (size_t)reader->header[0] * reader->header[1];
+			reader->points = malloc((reader->total + 1) * sizeof(int));
+			DIE(!reader->points, "Malloc for array of points failed");
+		}
+		return;
+	}
 
-	int n;
-	fscanf(in, "%d %d", &n, k);
+	if (reader->count < reader->total)
+		reader->points[reader->count++] = value;
+}
 
-	int *point = malloc(*k * sizeof(int));
-	DIE(!point, "Malloc for array of dimensions failed");
+static int is_space(char c)
+{
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
 
-	for (int i = 0; i < n; i++) {
-		for (int j = 0; j < *k; j++)
-			fscanf(in, "%d", &point[j]);
-		bst_insert_node(bst, point, k);
+/**
+ * Parses the integers of a block, returning where the unfinished number at
+ * its end starts, or the size of the block if there's none
+ */
+static size_t parse_points(point_reader_t *reader, const char *data,
+						   size_t size, int last)
+{
+	size_t i = 0;
+
+	while (i < size) {
+		while (i < size && is_space(data[i]))
+			i++;
+
+		if (i == size)
+			break;
+
+		size_t start = i;
+		int negative = data[i] == '-';
+		if (data[i] == '-' || data[i] == '+')
+			i++;
+
+		unsigned long long value = 0;
+		size_t digits = i;
+		while (i < size && (unsigned char)(data[i] - '0') < 10)
+			value = value * 10 + (data[i++] - '0');
+
+		/**
+		 * A number reaching the end of the block is left for the next one
+		 */
+		if (i == size && !last)
+			return start;
+
+		INVALID(i == digits || (i < size && !is_space(data[i])),
+			"Invalid number in the ascii file");
+
+		/**
+		 * More than 10 digits could have wrapped around the value
+		 */
+		INVALID(i - digits > 10 ||
+				value > (unsigned long long)INT_MAX + negative,
+			"Number too large in the ascii file");
+
+		reader_push(reader, negative ? (int)-(long long)value : (int)value);
 	}
 
-	free(point);
-	fclose(in);
+	return size;
 }
 
-double distance(node_t *point1, node_t *point2, int *k)
+int *read_points(char *filename, int *n, int *k)
 {
-	double sum = 0;
-	for (int i = 0; i < *k; i++) {
-		double diff = point1->coord[i] - point2->coord[i];
-		sum += pow(diff, 2);
+	int fd = open(filename, O_RDONLY);
+	DIE(fd < 0, "Can't open the ascii file");
+
+	struct stat st;
+	DIE(fstat(fd, &st) < 0, "Can't stat the ascii file");
+
+	point_reader_t reader = {0};
+
+	/**
+	 * The file is mapped and parsed in a single pass, straight into
+	 * the array of coordinates
+	 */
+	void *data = MAP_FAILED;
+	if (st.st_size > 0)
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (data != MAP_FAILED) {
+		posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+		parse_points(&reader, data, st.st_size, 1);
+		munmap(data, st.st_size);
+
+	} else {
+		/**
+		 * Files that can't be mapped are read in large blocks, the
+		 * unfinished number of a block being moved at the start
+		 */
+		char *block = malloc(LOAD_BLOCK);
+		DIE(!block, "Malloc for load block failed");
+
+		size_t used = 0;
+		while (1) {
+			ssize_t bytes = read(fd, block + used, LOAD_BLOCK - used);
+			DIE(bytes < 0, "Can't read the ascii file");
+
+			used += bytes;
+			size_t rest = parse_points(&reader, block, used, !bytes);
+			INVALID(!rest && used == LOAD_BLOCK,
+				"Invalid number in the ascii file");
+
+			memmove(block, block + rest, used - rest);
+			used -= rest;
+
+			if (!bytes)
+				break;
+		}
+
+		free(block);
+	}
+
+	close(fd);
+
+	INVALID(reader.values < 2, "Missing header of the ascii file");
+
+	*n = reader.header[0];
+	*k = reader.header[1];
+
+	/**
+	 * Only the complete points of a truncated file are kept
+	 */
+	if (reader.count < reader.total) {
+		fprintf(stderr, "The ascii file has only %zu of its %d points\n",
+				reader.count / *k, *n);
+		*n = reader.count / *k;
 	}
-	return sqrt(sum);
+
+	return reader.points;
 }
 
-node_t *closest(node_t *node1, node_t *node2, node_t *target, int *k)
+void bst_load_file(bst_t *bst, char *filename, int *k)
 {
-	if (!node1)
-		return node2;
+	int n, dimensions;
+	int *points = read_points(filename, &n, &dimensions);
+
+	/**
+	 * The nodes of the arena are sized for the dimensions of the tree,
+	 * so a tree holding points only takes more of the same dimensions.
+	 * An empty one starts over with the dimensions of the file
+	 */
+	INVALID(bst->root && dimensions != *k,
+		"The file has other dimensions than the tree");
 
-	if (!node2)
-		return node1;
+	if (!bst->root && bst->arena.object_size && dimensions != *k) {
+		arena_destroy(&bst->arena);
+		bst->arena.object_size = 0;
+	}
+	*k = dimensions;
 
-	double dist1 = distance(node1, target, k);
-	double dist2 = distance(node2, target, k);
+	/**
+	 * An empty tree is built balanced from all the points at once,
+	 * otherwise the points are added one by one
+	 */
+	if (!bst->root) {
+		bst_bulk_load(bst, points, n, k);
+	} else {
+		for (int i = 0; i < n; i++)
+			bst_insert_node(bst, points + (size_t)i * *k, k);
+	}
 
-	if (dist1 < dist2)
-		return node1;
-	else
-		return node2;
+	free(points);
 }
 
-node_t *nn(node_t *root, node_t *target, int *k, int depth)
+dist_t distance(int *point1, int *point2, int *k)
 {
-	node_t *next = NULL;
-	node_t *other = NULL;
+	/**
+	 * Only compared with other distances, so the square root isn't needed
+	 * and the sum is kept exact in 128-bit integers
+	 */
+	COUNT(distances, 1);
 
+	dist_t sum = 0;
+	for (int i = 0; i < *k; i++)
+		sum += square_gap(point1[i], point2[i]);
+	return sum;
+}
+
+void closest(node_t *node, int *target, int *k, node_t **nearest,
+			 dist_t *best)
+{
+	dist_t dist = distance(node->coord, target, k);
+
+	if (!*nearest || dist < *best) {
+		*nearest = node;
+		*best = dist;
+	}
+}
+
+static void nn_search(node_t *root, int *target, int *k, int depth,
+					  node_t **nearest, dist_t *best)
+{
 	if (!root)
-		return NULL;
+		return;
+	COUNT(visited, 1);
 
 	/**
 	 * Selects the subtrie which can have the nearest neighbour
 	 */
-	if (target->coord[depth % *k] < root->coord[depth % *k]) {
-		next = root->left;
-		other = root->right;
-	} else {
-		next = root->right;
-		other = root->left;
-	}
+	int axis = depth % *k;
+	node_t *next = target[axis] < root->coord[axis] ? root->left : root->right;
+	node_t *other = next == root->left ? root->right : root->left;
 
 	/**
-	 * Finds a temporary nearest node and compares it's distance
-	 * with the root in order to exclude this subtree or to take it
-	 * into account
+	 * The root is compared with the best distance found so far, which
+	 * is kept up to date instead of being computed again
 	 */
-	node_t *temp = nn(next, target, k, depth + 1);
-	node_t *nearest = closest(temp, root, target, k);
+	closest(root, target, k, nearest, best);
+	nn_search(next, target, k, depth + 1, nearest, best);
 
 	/**
-	 * Checks the other subtree and if it's closer
-	 * iterates through it too.
+	 * Checks the other subtree only if the splitting plane
+	 * is closer than the nearest point found
 	 */
-	if (distance(target, nearest, k) >= target->coord[depth % *k] -
-		root->coord[depth % *k]) {
-		temp = nn(other, target, k, depth + 1);
-		nearest = closest(temp, nearest, target, k);
-	}
+	if (square_gap(target[axis], root->coord[axis]) < *best)
+		nn_search(other, target, k, depth + 1, nearest, best);
+	else
+		COUNT(pruned, 1);
+}
+
+node_t *nn(node_t *root, int *target, int *k, int depth)
+{
+	node_t *nearest = NULL;
+	dist_t best = 0;
+
+	nn_search(root, target, k, depth, &nearest, &best);
 
 	return nearest;
 }
 
+/**
+ * State of an approximate search
+ */
+typedef struct ann_search_t ann_search_t;
+struct ann_search_t {
+	int *target; // the target's coordinates
+	int *k; // dimensions
+	double shrink; // 1 / (1 + eps)^2, applied to the best squared distance
+	int max_visited; // nodes visited at most, 0 for no limit
+	int visited; // nodes visited so far
+	node_t *nearest; // nearest node found
+	dist_t best; // its squared distance
+};
+
+int ann_reachable(dist_t plane, dist_t best, double shrink)
+{
+	if (shrink == 1)
+		return plane < best;
+
+	return (double)plane < (double)best * shrink;
+}
+
+static void ann_search(ann_search_t *search, node_t *root, int depth)
+{
+	if (!root)
+		return;
+	if (search->max_visited && search->visited >= search->max_visited)
+		return;
+
+	search->visited++;
+	COUNT(visited, 1);
+	closest(root, search->target, search->k, &search->nearest,
+			&search->best);
+
+	int axis = depth % *search->k;
+	int *target = search->target;
+	node_t *next = target[axis] < root->coord[axis] ? root->left : root->right;
+	node_t *other = next == root->left ? root->right : root->left;
+
+	ann_search(search, next, depth + 1);
+
+	/**
+	 * The other side is searched only if it can hold a point nearer
+	 * than best / (1 + eps), so the answer is within (1 + eps) of the
+	 * nearest distance
+	 */
+	if (ann_reachable(square_gap(target[axis], root->coord[axis]),
+					  search->best, search->shrink))
+		ann_search(search, other, depth + 1);
+	else
+		COUNT(pruned, 1);
+}
+
+node_t *ann(node_t *root, int *target, double eps, int max_visited, int *k,
+			int *visited)
+{
+	ann_search_t search;
+	search.target = target;
+	search.k = k;
+	search.shrink = 1 / ((1 + eps) * (1 + eps));
+	search.max_visited = max_visited;
+	search.visited = 0;
+	search.nearest = NULL;
+	search.best = 0;
+
+	ann_search(&search, root, 0);
+
+	*visited = search.visited;
+	return search.nearest;
+}
+
+/**
+ * Candidates are ordered by distance and the ties by coordinates,
+ * so the answer doesn't depend on the shape of the tree
+ */
+static int knn_farther(knn_heap_t *heap, int i, int j, int *k)
+{
+	if (heap->dist[i] != heap->dist[j])
+		return heap->dist[i] > heap->dist[j];
+
+	int *a = heap->points[i], *b = heap->points[j];
+	for (int d = 0; d < *k; d++) {
+		if (a[d] != b[d])
+			return a[d] > b[d];
+	}
+	return 0;
+}
+
+static void knn_swap(knn_heap_t *heap, int i, int j)
+{
+	int *point = heap->points[i];
+	heap->points[i] = heap->points[j];
+	heap->points[j] = point;
+
+	dist_t dist = heap->dist[i];
+	heap->dist[i] = heap->dist[j];
+	heap->dist[j] = dist;
+}
+
+static void knn_sift_down(knn_heap_t *heap, int i, int *k)
+{
+	while (1) {
+		int largest = i;
+		int left = 2 * i + 1, right = 2 * i + 2;
+
+		if (left < heap->size && knn_farther(heap, left, largest, k))
+			largest = left;
+		if (right < heap->size && knn_farther(heap, right, largest, k))
+			largest = right;
+
+		if (largest == i)
+			return;
+
+		knn_swap(heap, i, largest);
+		i = largest;
+	}
+}
+
+void knn_heap_init(knn_heap_t *heap, int count)
+{
+	heap->size = 0;
+	heap->capacity = count;
+
+	heap->points = malloc(((size_t)count + 1) * sizeof(int *));
+	DIE(!heap->points, "Malloc for knn candidates failed");
+
+	heap->dist = malloc(((size_t)count + 1) * sizeof(dist_t));
+	DIE(!heap->dist, "Malloc for knn distances failed");
+}
+
+/**
+ * The slot after the last candidate is used to compare a new point
+ * with the farthest one
+ */
+void knn_push(knn_heap_t *heap, int *point, dist_t dist, int *k)
+{
+	int i = heap->size;
+	heap->points[i] = point;
+	heap->dist[i] = dist;
+
+	if (heap->size < heap->capacity) {
+		heap->size++;
+
+		while (i && knn_farther(heap, i, (i - 1) / 2, k)) {
+			knn_swap(heap, i, (i - 1) / 2);
+			i = (i - 1) / 2;
+		}
+		return;
+	}
+
+	if (knn_farther(heap, 0, i, k)) {
+		knn_swap(heap, 0, i);
+		knn_sift_down(heap, 0, k);
+	}
+}
+
+int knn_heap_sort(knn_heap_t *heap, int **result, int *k)
+{
+	/**
+	 * Taking out the farthest candidate every time fills
+	 * the result from its end, sorted by distance
+	 */
+	int found = heap->size;
+	while (heap->size) {
+		result[heap->size - 1] = heap->points[0];
+		heap->size--;
+		knn_swap(heap, 0, heap->size);
+		knn_sift_down(heap, 0, k);
+	}
+
+	free(heap->points);
+	free(heap->dist);
+
+	return found;
+}
+
+static void knn_search(node_t *root, int *target, int depth, int *k,
+					   knn_heap_t *heap)
+{
+	if (!root)
+		return;
+	COUNT(visited, 1);
+
+	knn_push(heap, root->coord, distance(root->coord, target, k), k);
+
+	/**
+	 * The side of the target is searched first. The other one can
+	 * be skipped only if there are enough candidates and the splitting
+	 * plane is farther than the K-th of them
+	 */
+	int axis = depth % *k;
+	node_t *next = target[axis] < root->coord[axis] ? root->left : root->right;
+	node_t *other = next == root->left ? root->right : root->left;
+
+	knn_search(next, target, depth + 1, k, heap);
+
+	if (heap->size < heap->capacity ||
+		square_gap(target[axis], root->coord[axis]) <= heap->dist[0])
+		knn_search(other, target, depth + 1, k, heap);
+	else
+		COUNT(pruned, 1);
+}
+
+int knn(node_t *root, int *target, int count, int *k, int **result)
+{
+	/**
+	 * There can't be more neighbours than points in the tree
+	 */
+	if (root && count > root->size)
+		count = root->size;
+	if (!root || count <= 0)
+		return 0;
+
+	knn_heap_t heap;
+	knn_heap_init(&heap, count);
+	knn_search(root, target, 0, k, &heap);
+
+	return knn_heap_sort(&heap, result, k);
+}
+
 int is_outside_range(node_t *node, int *start, int *end, int *k)
 {
 	for (int i = 0; i < *k; i++) {
@@ -211,21 +942,36 @@ int is_outside_range(node_t *node, int *start, int *end, int *k)
 	return 0;
 }
 
-void rs(node_t *root, int *start, int *end, int depth, int *k)
+void rs(node_t *root, int *start, int *end, int depth, int *k,
+		rs_callback_t callback, void *data)
 {
 	if (!root)
 		return;
+	COUNT(visited, 1);
 
-	rs(root->right, start, end, depth + 1, k);
+	int axis = depth % *k;
+
+	/**
+	 * The right subtree holds only points with a splitting coordinate
+	 * greater or equal to the root's one, so it can be skipped when
+	 * the range ends before the root on this axis
+	 */
+	if (end[axis] >= root->coord[axis])
+		rs(root->right, start, end, depth + 1, k, callback, data);
+	else
+		COUNT(pruned, 1);
 
 	/**
 	 * Check if the current node lies within the given range
 	 */
-	if (!is_outside_range(root, start, end, k)) {
-		for (int i = 0 ; i < *k; i++)
-			printf("%d ", root->coord[i]);
-		printf("\n");
-	}
+	if (!is_outside_range(root, start, end, k))
+		callback(root->coord, k, data);
 
-	rs(root->left, start, end, depth + 1, k);
+	/**
+	 * Same for the left subtree, which can't hold points past the root
+	 */
+	if (start[axis] <= root->coord[axis])
+		rs(root->left, start, end, depth + 1, k, callback, data);
+	else
+		COUNT(pruned, 1);
 }
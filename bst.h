@@ -2,31 +2,79 @@
 #ifndef ABC_H
 #define ABC_H
 
+#include "arena.h"
 #include "utils.h"
 
+#define BST_ALPHA 0.7  // most of a subtree a child may hold, as a fraction
+#define BST_MAX_DEPTH 128  // bound of the depth kept by the rebuilds
+
 typedef struct node_t node_t;
 struct node_t {
 	node_t *left; /* left child */
 	node_t *right; /* right child */
+	int size; /* number of points in the subtree */
 
-	int *coord; /* point's coordinates */
+	int coord[]; /* point's coordinates, stored with the node */
+};
+
+/**
+ * @brief Receives every point found by a range search.
+ *
+ * @param coord the point's coordinates
+ * @param k dimensions
+ * @param data the caller's context
+ */
+typedef void (*rs_callback_t)(int *coord, int *k, void *data);
+
+/**
+ * Squared distance between two points. The square of the difference of two
+ * int coordinates is below 2^64, and 128 bits hold the sum of any number of
+ * them, so distances are exact for every int coordinate
+ */
+__extension__ typedef unsigned __int128 dist_t;
+
+/**
+ * @brief The function returns the squared difference of two coordinates.
+ *
+ * @param a first coordinate
+ * @param b second coordinate
+ * @return dist_t
+ */
+static inline dist_t square_gap(int a, int b)
+{
+	long long gap = (long long)a - b;
+	unsigned long long size = gap < 0 ? -gap : gap;
+
+	return (dist_t)size * size;
+}
+
+typedef struct knn_heap_t knn_heap_t;
+struct knn_heap_t {
+	int **points; /* coordinates of the candidates, the farthest on top */
+	dist_t *dist; /* squared distance of every candidate */
+	int size; /* number of candidates */
+	int capacity; /* how many neighbours are searched */
 };
 
 typedef struct bst_t bst_t;
 struct bst_t {
 	node_t  *root; /* root of the tree */
 	int size; /* number of points in the tree*/
+	int max_size; /* most points since the last rebuild of the whole tree */
+
+	arena_t arena; /* where the nodes are allocated from */
 };
 
 /**
- * @brief The function returns a dynamically allocated
- * node structure with all fields initialized.
+ * @brief The function returns a node structure allocated from
+ * the arena of the tree, with all fields initialized.
  * 
+ * @param bst the bst
  * @param point the point data
  * @param k dimensions
  * @return node_t* the node
  */
-node_t *bst_create_node(int *point, int *k);
+node_t *bst_create_node(bst_t *bst, int *point, int *k);
 
 /**
  * @brief The function returns a dynamically allocated
@@ -37,7 +85,10 @@ node_t *bst_create_node(int *point, int *k);
 bst_t *bst_create_tree(void);
 
 /**
- * @brief The function inserts a new word in the k-d tree.
+ * @brief The function inserts a new word in the k-d tree. If the new
+ * leaf is deeper than log in base 1 / BST_ALPHA of the size of the tree,
+ * the lowest ancestor having a child with more than BST_ALPHA of its
+ * points is rebuilt balanced (scapegoat tree).
  * 
  * @param bst the bst
  * @param point the point
@@ -46,63 +97,228 @@ bst_t *bst_create_tree(void);
 void bst_insert_node(bst_t *bst, int *point, int *k);
 
 /**
- * @brief The function frees the momory used by a node.
+ * @brief The function copies the points of a subtree one after another
+ * in the array, in inorder.
+ * 
+ * @param node the root of the subtree
+ * @param points the array, having room for all the points
+ * @param pos the number of points already in the array, increased
+ * @param k dimensions
+ */
+void collect_points(node_t *node, int *points, int *pos, int *k);
+
+/**
+ * @brief The function rearranges n points stored one after another
+ * (nth_element style) so that the mid-th one has the median coordinate
+ * on the given axis, the ones before it are less or equal and the ones
+ * after it are greater or equal.
+ * 
+ * @param points the points
+ * @param n number of points
+ * @param mid the position of the median
+ * @param axis the coordinate compared
+ * @param k dimensions
+ */
+void select_median(int *points, int n, int mid, int axis, int k);
+
+/**
+ * @brief The function builds a balanced k-d tree from n distinct points
+ * stored one after another, splitting them on the median coordinate at
+ * every level. The order of the points in the array is changed.
+ * 
+ * @param bst the bst, whose arena holds the nodes
+ * @param points the points
+ * @param n number of points
+ * @param depth the depth of the subtree's root
+ * @param k dimensions
+ * @return node_t* the root of the subtree
+ */
+node_t *bst_build(bst_t *bst, int *points, int n, int depth, int *k);
+
+/**
+ * @brief The function fills an empty k-d tree with n points stored one
+ * after another in the given array. Identical points are kept once and
+ * the tree is built balanced, having O(log n) depth.
  * 
+ * @param bst the bst
+ * @param points the points
+ * @param n number of points
+ * @param k dimensions
+ */
+void bst_bulk_load(bst_t *bst, int *points, int n, int *k);
+
+/**
+ * @brief The function gives the nodes of a subtree back to
+ * the arena of the tree, which reuses them.
+ * 
+ * @param bst the bst
  * @param node th node
  */
-void bst_free_subtree(node_t *node);
+void bst_free_subtree(bst_t *bst, node_t *node);
 
 /**
- * @brief The functions calls recursively the bst_free_subtree
- * function in order to free the entire memory used by the tree.
+ * @brief The function deletes a point from the k-d tree. A node deleted
+ * takes the point with the smallest coordinate on its axis from one of
+ * its subtrees, which is deleted from there in turn. The whole tree is
+ * rebuilt once it holds less than BST_ALPHA of the most points it had.
+ * 
+ * @param bst the bst
+ * @param point the point
+ * @param k dimensions
+ * @return int 1 if the point was in the tree, 0 otherwise
+ */
+int bst_delete_node(bst_t *bst, int *point, int *k);
+
+/**
+ * @brief The function returns the number of levels of a subtree.
+ * 
+ * @param node the root of the subtree
+ * @return int the depth, 0 for an empty subtree
+ */
+int bst_depth(node_t *node);
+
+/**
+ * @brief The functions frees the arena, and with it all the
+ * nodes, at once and then the tree.
  * 
  * @param bst the bst
  */
 void bst_free_tree(bst_t *bst);
 
+/**
+ * @brief The function reads a file of points, a header with their number
+ * and dimensions followed by their coordinates, in a single array. The file
+ * is mapped in memory when possible, otherwise it's read in blocks.
+ * 
+ * @param filename the filename
+ * @param n number of points read
+ * @param k dimensions read
+ * @return the coordinates of the points, one after another
+ */
+int *read_points(char *filename, int *n, int *k);
+
 /**
  * @brief The function loads a file given as input and inserts
- * in a k-d tree all the points previously read.
+ * in a k-d tree all the points previously read. If the tree is empty
+ * it's built balanced from all the points at once. A file having other
+ * dimensions than a tree that isn't empty stops the program.
  * 
  * @param bst the bst
  * @param filename the filename
- * @param k dimensions
+ * @param k dimensions, set to the ones of the file
  */
-void load_file(bst_t *bst, char *filename, int *k);
+void bst_load_file(bst_t *bst, char *filename, int *k);
 
 /**
  * 
- * @brief The function calculates the euclidian
- * distance between two points
+ * @brief The function calculates the squared euclidian distance between
+ * two points, exact for any int coordinates
  * 
  * @param point1 first point
  * @param point2 second point
  * @param k dimensions
- * @return double 
+ * @return dist_t 
  */
-double distance(node_t *point1, node_t *point2, int *k);
+dist_t distance(int *point1, int *point2, int *k);
 
 /**
- * @brief The function retuns which node is closer to the target node.
+ * @brief The function makes the node the nearest one if it's closer
+ * to the target than the best distance found so far.
  * 
- * @param temp temporary node
- * @param root the root
- * @param target the target
+ * @param node the node
+ * @param target the target's coordinates
  * @param k dimensions
- * @return node_t* 
+ * @param nearest the nearest node so far, NULL at first
+ * @param best the squared distance of the nearest node
  */
-node_t *closest(node_t *temp, node_t *root, node_t *target, int *k);
+void closest(node_t *node, int *target, int *k, node_t **nearest,
+			 dist_t *best);
 
 /**
- * @brief The function returns the nearest node to the target node.
+ * @brief The function returns the nearest node to the target.
  * 
  * @param root the root
- * @param target the target
+ * @param target the target's coordinates
  * @param k how many dimensions
  * @param depth the depth
  * @return node_t* 
  */
-node_t *nn(node_t *root, node_t *target, int *k, int depth);
+node_t *nn(node_t *root, int *target, int *k, int depth);
+
+/**
+ * @brief The function tells whether the approximate searches must visit
+ * the other side of a splitting plane: only if it can hold a point nearer
+ * than best / (1 + eps). For eps 0 the distances are compared exactly.
+ * 
+ * @param plane the squared distance to the splitting plane
+ * @param best the squared distance of the nearest point found
+ * @param shrink 1 / (1 + eps)^2
+ * @return int 1 if the other side must be searched
+ */
+int ann_reachable(dist_t plane, dist_t best, double shrink);
+
+/**
+ * @brief The function returns a node within (1 + eps) of the distance of
+ * the nearest one: a subtree is skipped when its splitting plane is farther
+ * than the best distance found divided by (1 + eps). With max_visited, the
+ * search stops after that many nodes and the answer has no bound.
+ * 
+ * @param root the root
+ * @param target the target's coordinates
+ * @param eps the allowed relative error, 0 for the exact nearest
+ * @param max_visited nodes visited at most, 0 for no limit
+ * @param k how many dimensions
+ * @param visited the number of nodes visited
+ * @return node_t* 
+ */
+node_t *ann(node_t *root, int *target, double eps, int max_visited, int *k,
+			int *visited);
+
+/**
+ * @brief The function finds the count nearest points to the target using
+ * a bounded max-heap of candidates and skips the subtrees that are farther
+ * than the count-th candidate.
+ * 
+ * @param root the root
+ * @param target the target's coordinates
+ * @param count how many neighbours are searched, at most the size of the tree
+ * @param k dimensions
+ * @param result receives the coordinates of the neighbours, sorted by
+ * distance
+ * @return int how many neighbours were found
+ */
+int knn(node_t *root, int *target, int count, int *k, int **result);
+
+/**
+ * @brief The function prepares a heap for the count nearest points, used
+ * by knn() and flat_knn().
+ * 
+ * @param heap the heap
+ * @param count how many neighbours are searched, more than 0
+ */
+void knn_heap_init(knn_heap_t *heap, int count);
+
+/**
+ * @brief The function adds a point to the candidates. Once the heap is
+ * full, the point replaces the farthest candidate only if it's closer.
+ * 
+ * @param heap the heap
+ * @param point the point's coordinates
+ * @param dist its squared distance to the target
+ * @param k dimensions
+ */
+void knn_push(knn_heap_t *heap, int *point, dist_t dist, int *k);
+
+/**
+ * @brief The function moves the candidates in the result, sorted by
+ * distance and, for equal distances, by coordinates, and frees the heap.
+ * 
+ * @param heap the heap
+ * @param result receives the coordinates of the candidates
+ * @param k dimensions
+ * @return int how many candidates there were
+ */
+int knn_heap_sort(knn_heap_t *heap, int **result, int *k);
 
 /**
  * @brief The function checks if the given node is outside the range.
@@ -116,14 +332,19 @@ node_t *nn(node_t *root, node_t *target, int *k, int depth);
 int is_outside_range(node_t *node, int *start, int *end, int *k);
 
 /**
- * @brief The function prints all the points within the given range.
+ * @brief The function passes to the callback all the points within the
+ * given range. Subtrees that can't overlap the range on the splitting
+ * coordinate are skipped.
  * 
  * @param root the root
  * @param start the start
- * @param end teh end
+ * @param end the end
  * @param depth the depth
  * @param k dimensions
+ * @param callback called for every point found
+ * @param data passed as it is to the callback
  */
-void rs(node_t *root, int *start, int *end, int depth, int *k);
+void rs(node_t *root, int *start, int *end, int depth, int *k,
+		rs_callback_t callback, void *data);
 
 #endif /* ABC_H_ */
@@ -0,0 +1,90 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "counters.h"
+
+counters_t counters;
+
+static double counters_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void counters_read(counters_t *copy)
+{
+	copy->visited = __atomic_load_n(&counters.visited, __ATOMIC_RELAXED);
+	copy->pruned = __atomic_load_n(&counters.pruned, __ATOMIC_RELAXED);
+	copy->distances = __atomic_load_n(&counters.distances, __ATOMIC_RELAXED);
+}
+
+void counters_begin(counters_log_t *log)
+{
+	counters_read(&log->before);
+	log->start = counters_now();
+}
+
+void counters_end(counters_log_t *log, const char *command)
+{
+	double seconds = counters_now() - log->start;
+	counters_t after;
+	counters_read(&after);
+
+	int i = 0;
+	while (i < log->commands && strncmp(log->command[i].name, command,
+										COUNTERS_NAME - 1))
+		i++;
+
+	/**
+	 * The commands past the last slot are left out
+	 */
+	if (i == COUNTERS_COMMANDS)
+		return;
+
+	counters_command_t *entry = &log->command[i];
+	if (i == log->commands) {
+		memset(entry, 0, sizeof(*entry));
+		snprintf(entry->name, COUNTERS_NAME, "%s", command);
+		log->commands++;
+	}
+
+	entry->count++;
+	entry->seconds += seconds;
+	entry->total.visited += after.visited - log->before.visited;
+	entry->total.pruned += after.pruned - log->before.pruned;
+	entry->total.distances += after.distances - log->before.distances;
+
+	int bucket = 0;
+	for (double limit = 1e-6; seconds >= limit &&
+		 bucket < COUNTERS_BUCKETS - 1; limit *= 2)
+		bucket++;
+	entry->histogram[bucket]++;
+}
+
+void counters_print(counters_log_t *log)
+{
+#ifndef STATS
+	(void)log;
+	printf("Statistics disabled, build with make STATS=-DSTATS\n");
+#else
+	for (int i = 0; i < log->commands; i++) {
+		counters_command_t *entry = &log->command[i];
+		double count = entry->count;
+
+		printf("%s count %ld avg_us %.3f visited %.1f pruned %.1f "
+			   "distances %.1f latency_us", entry->name, entry->count,
+			   entry->seconds / count * 1e6, entry->total.visited / count,
+			   entry->total.pruned / count, entry->total.distances / count);
+
+		for (int b = 0; b < COUNTERS_BUCKETS; b++)
+			if (entry->histogram[b])
+				printf(" <%ld:%ld", 1L << b, entry->histogram[b]);
+		printf("\n");
+	}
+#endif
+}
@@ -0,0 +1,91 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include "utils.h"
+
+#define COUNTERS_COMMANDS 24  // different commands kept by a log
+#define COUNTERS_NAME 16  // letters kept of the name of a command
+#define COUNTERS_BUCKETS 32  // powers of two of the latency histogram
+
+/**
+ * What the searches did, added up from the start of the program.
+ * The trie searches count the nodes of their dfs as visited and the
+ * subtrees cut off by the autocorrect distance as pruned.
+ */
+typedef struct counters_t counters_t;
+struct counters_t {
+	long long visited; // nodes visited
+	long long pruned; // subtrees skipped
+	long long distances; // distances computed
+};
+
+extern counters_t counters;
+
+/**
+ * The counters are only kept in a build with -DSTATS (make STATS=-DSTATS).
+ * Otherwise COUNT() and the log hooks expand to nothing, so the searches
+ * cost the same as without them. The adds are atomic, as the searches may
+ * run in several threads.
+ */
+#ifdef STATS
+#define COUNT(counter, n) \
+	__atomic_fetch_add(&counters.counter, (n), __ATOMIC_RELAXED)
+#define COUNTERS_BEGIN(log) counters_begin(log)
+#define COUNTERS_END(log, command) counters_end(log, command)
+#else
+#define COUNT(counter, n) ((void)0)
+#define COUNTERS_BEGIN(log) ((void)0)
+#define COUNTERS_END(log, command) ((void)0)
+#endif
+
+/**
+ * The commands of one name: how many ran, what their searches did and
+ * a histogram of their latencies, bucket b counting the ones under
+ * 2^b microseconds and not under 2^(b - 1)
+ */
+typedef struct counters_command_t counters_command_t;
+struct counters_command_t {
+	char name[COUNTERS_NAME];
+	long count;
+	double seconds;
+	counters_t total;
+	long histogram[COUNTERS_BUCKETS];
+};
+
+typedef struct counters_log_t counters_log_t;
+struct counters_log_t {
+	counters_command_t command[COUNTERS_COMMANDS];
+	int commands;
+	counters_t before; // the counters when the command started
+	double start; // the time when the command started
+};
+
+/**
+ * @brief The function marks the start of a command.
+ * 
+ * @param log the log
+ */
+void counters_begin(counters_log_t *log);
+
+/**
+ * @brief The function adds to the log the time of the command and what
+ * the searches did since counters_begin().
+ * 
+ * @param log the log
+ * @param command the name of the command
+ */
+void counters_end(counters_log_t *log, const char *command);
+
+/**
+ * @brief The function prints a line for every command in the log: how
+ * many ran, their mean latency, the nodes visited, the subtrees pruned
+ * and the distances computed per command, then the non-empty buckets of
+ * the latency histogram as <limit_us:count. Without -DSTATS it prints
+ * that the statistics are disabled.
+ * 
+ * @param log the log
+ */
+void counters_print(counters_log_t *log);
+
+#endif /* COUNTERS_H */
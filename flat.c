@@ -0,0 +1,515 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+#include "counters.h"
+#include "flat.h"
+#include "snapshot.h"
+
+/**
+ * Puts the points of [lo, hi) in tree order: the median on the
+ * splitting coordinate goes in the middle of the range
+ */
+static void arrange(int *coord, int lo, int hi, int depth, int k, int bucket)
+{
+	/**
+	 * A range that fits in a bucket is a leaf, its points stay
+	 * one after another in any order and are scanned together
+	 */
+	if (hi - lo <= bucket)
+		return;
+
+	int mid = lo + (hi - lo) / 2;
+	select_median(coord + (size_t)lo * k, hi - lo, mid - lo, depth % k, k);
+
+	arrange(coord, lo, mid, depth + 1, k, bucket);
+	arrange(coord, mid + 1, hi, depth + 1, k, bucket);
+}
+
+flat_t *flat_create(bst_t *bst, int *k, int bucket)
+{
+	/**
+	 * Allocates space defensively for the flat tree
+	 * and assigns each field of the stucture
+	 */
+	flat_t *flat = malloc(sizeof(flat_t));
+	DIE(!flat, "Malloc for flat tree failed");
+
+	flat->k = *k;
+	flat->size = 0;
+	flat->bucket = bucket > 1 ? bucket : 1;
+	flat->mapped = 0;
+
+	flat->coord = malloc(((size_t)bst->size * *k + 1) * sizeof(int));
+	DIE(!flat->coord, "Malloc for flat tree coordinates failed");
+
+	collect_points(bst->root, flat->coord, &flat->size, k);
+	arrange(flat->coord, 0, flat->size, 0, *k, flat->bucket);
+
+	return flat;
+}
+
+static int range_depth(int lo, int hi, int bucket)
+{
+	if (hi - lo <= 0)
+		return 0;
+	if (hi - lo <= bucket)
+		return 1;
+
+	int mid = lo + (hi - lo) / 2;
+	int left = range_depth(lo, mid, bucket);
+	int right = range_depth(mid + 1, hi, bucket);
+
+	return 1 + (left > right ? left : right);
+}
+
+int flat_depth(flat_t *flat)
+{
+	return range_depth(0, flat->size, flat->bucket);
+}
+
+void flat_free(flat_t *flat)
+{
+	if (flat->mapped)
+		munmap((char *)flat->coord - sizeof(flat_header_t), flat->mapped);
+	else
+		free(flat->coord);
+	free(flat);
+}
+
+void flat_save(flat_t *flat, char *filename)
+{
+	char *temp;
+	FILE *out = snapshot_create(filename, &temp);
+
+	flat_header_t header = {
+		.magic = FLAT_MAGIC,
+		.version = FLAT_VERSION,
+		.byte_order = FLAT_BYTE_ORDER,
+		.k = flat->k,
+		.size = flat->size,
+		.bucket = flat->bucket,
+	};
+
+	/**
+	 * The array is already in tree order, so it's written as it is
+	 */
+	size_t count = (size_t)flat->size * flat->k;
+	DIE(fwrite(&header, sizeof(header), 1, out) != 1,
+		"Can't write the snapshot");
+	DIE(fwrite(flat->coord, sizeof(int), count, out) != count,
+		"Can't write the snapshot");
+	snapshot_commit(out, temp, filename);
+}
+
+flat_t *flat_open(char *filename)
+{
+	int fd = open(filename, O_RDONLY);
+	DIE(fd < 0, "Can't open the snapshot");
+
+	struct stat st;
+	DIE(fstat(fd, &st) < 0, "Can't stat the snapshot");
+	INVALID((size_t)st.st_size < sizeof(flat_header_t), "Invalid snapshot");
+
+	/**
+	 * The tree is never written, so a read only mapping lets every
+	 * process opening the file share the same cached pages
+	 */
+	char *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	DIE(data == MAP_FAILED, "Can't map the snapshot");
+	close(fd);
+
+	flat_header_t *header = (flat_header_t *)data;
+	INVALID(memcmp(header->magic, FLAT_MAGIC, sizeof(header->magic)) ||
+		header->version != FLAT_VERSION, "Invalid snapshot");
+	INVALID(header->byte_order != FLAT_BYTE_ORDER,
+		"Snapshot saved on an incompatible machine");
+	INVALID(header->k <= 0 || header->size < 0 || header->bucket < 1 ||
+		(size_t)st.st_size != sizeof(flat_header_t) +
+		(size_t)header->size * header->k * sizeof(int), "Truncated snapshot");
+
+	flat_t *flat = malloc(sizeof(flat_t));
+	DIE(!flat, "Malloc for flat tree failed");
+
+	flat->coord = (int *)(data + sizeof(flat_header_t));
+	flat->size = header->size;
+	flat->k = header->k;
+	flat->bucket = header->bucket;
+	flat->mapped = st.st_size;
+
+	return flat;
+}
+
+/**
+ * Squared distance between two points. The vector versions take the
+ * difference of two coordinates as max - min, which is exact as an unsigned
+ * 32-bit value however far apart they are, and square it in 64 bits. The
+ * squares are added in two halves, their low and high 32 bits, so the
+ * 64-bit lanes don't overflow for any int k and the sum is as exact as in
+ * distance()
+ */
+static dist_t point_distance(int *point1, int *point2, int k)
+{
+	COUNT(distances, 1);
+
+	dist_t sum = 0;
+	int i = 0;
+
+#if defined(__AVX2__)
+	__m256i low = _mm256_setzero_si256(), high = _mm256_setzero_si256();
+	__m256i mask = _mm256_set1_epi64x(0xFFFFFFFF);
+	for (; i + 8 <= k; i += 8) {
+		__m256i a = _mm256_loadu_si256((__m256i *)(point1 + i));
+		__m256i b = _mm256_loadu_si256((__m256i *)(point2 + i));
+		__m256i diff = _mm256_sub_epi32(_mm256_max_epi32(a, b),
+										_mm256_min_epi32(a, b));
+
+		/**
+		 * The even lanes are squared in 64 bits, then the odd ones
+		 */
+		__m256i even = _mm256_mul_epu32(diff, diff);
+		diff = _mm256_srli_epi64(diff, 32);
+		__m256i odd = _mm256_mul_epu32(diff, diff);
+
+		low = _mm256_add_epi64(low, _mm256_and_si256(even, mask));
+		low = _mm256_add_epi64(low, _mm256_and_si256(odd, mask));
+		high = _mm256_add_epi64(high, _mm256_srli_epi64(even, 32));
+		high = _mm256_add_epi64(high, _mm256_srli_epi64(odd, 32));
+	}
+
+	unsigned long long lanes[4], carry[4];
+	_mm256_storeu_si256((__m256i *)lanes, low);
+	_mm256_storeu_si256((__m256i *)carry, high);
+	sum = lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+		  ((dist_t)(carry[0] + carry[1] + carry[2] + carry[3]) << 32);
+#elif defined(__SSE4_1__)
+	__m128i low = _mm_setzero_si128(), high = _mm_setzero_si128();
+	__m128i mask = _mm_set1_epi64x(0xFFFFFFFF);
+	for (; i + 4 <= k; i += 4) {
+		__m128i a = _mm_loadu_si128((__m128i *)(point1 + i));
+		__m128i b = _mm_loadu_si128((__m128i *)(point2 + i));
+		__m128i diff = _mm_sub_epi32(_mm_max_epi32(a, b),
+									 _mm_min_epi32(a, b));
+
+		__m128i even = _mm_mul_epu32(diff, diff);
+		diff = _mm_srli_epi64(diff, 32);
+		__m128i odd = _mm_mul_epu32(diff, diff);
+
+		low = _mm_add_epi64(low, _mm_and_si128(even, mask));
+		low = _mm_add_epi64(low, _mm_and_si128(odd, mask));
+		high = _mm_add_epi64(high, _mm_srli_epi64(even, 32));
+		high = _mm_add_epi64(high, _mm_srli_epi64(odd, 32));
+	}
+
+	unsigned long long lanes[2], carry[2];
+	_mm_storeu_si128((__m128i *)lanes, low);
+	_mm_storeu_si128((__m128i *)carry, high);
+	sum = lanes[0] + lanes[1] + ((dist_t)(carry[0] + carry[1]) << 32);
+#endif
+
+	for (; i < k; i++)
+		sum += square_gap(point1[i], point2[i]);
+	return sum;
+}
+
+/**
+ * Returns 1 if the point lies within the range
+ */
+static int point_inside(int *point, int *start, int *end, int k)
+{
+	int i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 8 <= k; i += 8) {
+		__m256i c = _mm256_loadu_si256((__m256i *)(point + i));
+		__m256i low = _mm256_loadu_si256((__m256i *)(start + i));
+		__m256i high = _mm256_loadu_si256((__m256i *)(end + i));
+		__m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(low, c),
+									  _mm256_cmpgt_epi32(c, high));
+		if (_mm256_movemask_epi8(out))
+			return 0;
+	}
+#elif defined(__SSE4_1__)
+	for (; i + 4 <= k; i += 4) {
+		__m128i c = _mm_loadu_si128((__m128i *)(point + i));
+		__m128i low = _mm_loadu_si128((__m128i *)(start + i));
+		__m128i high = _mm_loadu_si128((__m128i *)(end + i));
+		__m128i out = _mm_or_si128(_mm_cmpgt_epi32(low, c),
+								   _mm_cmpgt_epi32(c, high));
+		if (_mm_movemask_epi8(out))
+			return 0;
+	}
+#endif
+
+	for (; i < k; i++) {
+		if (point[i] < start[i] || point[i] > end[i])
+			return 0;
+	}
+	return 1;
+}
+
+static void flat_nn_range(flat_t *flat, int lo, int hi, int depth,
+						  int *target, int **nearest, dist_t *best)
+{
+	if (lo >= hi)
+		return;
+
+	int k = flat->k;
+
+	/**
+	 * The points of a leaf are all compared with the target
+	 */
+	if (hi - lo <= flat->bucket) {
+		COUNT(visited, hi - lo);
+		for (int i = lo; i < hi; i++) {
+			int *point = flat->coord + (size_t)i * k;
+			dist_t dist = point_distance(point, target, k);
+
+			if (!*nearest || dist < *best) {
+				*nearest = point;
+				*best = dist;
+			}
+		}
+		return;
+	}
+
+	int mid = lo + (hi - lo) / 2;
+	int *root = flat->coord + (size_t)mid * k;
+
+	COUNT(visited, 1);
+	dist_t dist = point_distance(root, target, k);
+	if (!*nearest || dist < *best) {
+		*nearest = root;
+		*best = dist;
+	}
+
+	/**
+	 * Searches first the side of the target and then the other
+	 * one, only if the splitting plane is closer than the best point
+	 */
+	int axis = depth % k;
+	dist_t plane = square_gap(target[axis], root[axis]);
+	if (target[axis] < root[axis]) {
+		flat_nn_range(flat, lo, mid, depth + 1, target, nearest, best);
+		if (plane < *best)
+			flat_nn_range(flat, mid + 1, hi, depth + 1, target, nearest, best);
+		else
+			COUNT(pruned, 1);
+	} else {
+		flat_nn_range(flat, mid + 1, hi, depth + 1, target, nearest, best);
+		if (plane < *best)
+			flat_nn_range(flat, lo, mid, depth + 1, target, nearest, best);
+		else
+			COUNT(pruned, 1);
+	}
+}
+
+int *flat_nn(flat_t *flat, int *target)
+{
+	int *nearest = NULL;
+	dist_t best = 0;
+
+	flat_nn_range(flat, 0, flat->size, 0, target, &nearest, &best);
+
+	return nearest;
+}
+
+/**
+ * State of an approximate search
+ */
+typedef struct flat_ann_t flat_ann_t;
+struct flat_ann_t {
+	int *target; // the target's coordinates
+	double shrink; // 1 / (1 + eps)^2, applied to the best squared distance
+	int max_visited; // points visited at most, 0 for no limit
+	int visited; // points visited so far
+	int *nearest; // nearest point found
+	dist_t best; // its squared distance
+};
+
+static void flat_ann_visit(flat_ann_t *search, int *point, int k)
+{
+	dist_t dist = point_distance(point, search->target, k);
+
+	search->visited++;
+	COUNT(visited, 1);
+	if (!search->nearest || dist < search->best) {
+		search->nearest = point;
+		search->best = dist;
+	}
+}
+
+static void flat_ann_range(flat_t *flat, flat_ann_t *search, int lo, int hi,
+						   int depth)
+{
+	int k = flat->k;
+
+	if (lo >= hi)
+		return;
+	if (search->max_visited && search->visited >= search->max_visited)
+		return;
+
+	if (hi - lo <= flat->bucket) {
+		for (int i = lo; i < hi; i++) {
+			if (search->max_visited && search->visited >= search->max_visited)
+				break;
+			flat_ann_visit(search, flat->coord + (size_t)i * k, k);
+		}
+		return;
+	}
+
+	int mid = lo + (hi - lo) / 2;
+	int *root = flat->coord + (size_t)mid * k;
+	flat_ann_visit(search, root, k);
+
+	/**
+	 * The other side is searched only if it can hold a point nearer
+	 * than best / (1 + eps)
+	 */
+	int axis = depth % k;
+	dist_t plane = square_gap(search->target[axis], root[axis]);
+	if (search->target[axis] < root[axis]) {
+		flat_ann_range(flat, search, lo, mid, depth + 1);
+		if (ann_reachable(plane, search->best, search->shrink))
+			flat_ann_range(flat, search, mid + 1, hi, depth + 1);
+		else
+			COUNT(pruned, 1);
+	} else {
+		flat_ann_range(flat, search, mid + 1, hi, depth + 1);
+		if (ann_reachable(plane, search->best, search->shrink))
+			flat_ann_range(flat, search, lo, mid, depth + 1);
+		else
+			COUNT(pruned, 1);
+	}
+}
+
+int *flat_ann(flat_t *flat, int *target, double eps, int max_visited,
+			  int *visited)
+{
+	flat_ann_t search;
+	search.target = target;
+	search.shrink = 1 / ((1 + eps) * (1 + eps));
+	search.max_visited = max_visited;
+	search.visited = 0;
+	search.nearest = NULL;
+	search.best = 0;
+
+	flat_ann_range(flat, &search, 0, flat->size, 0);
+
+	*visited = search.visited;
+	return search.nearest;
+}
+
+static void flat_knn_range(flat_t *flat, int lo, int hi, int depth,
+						   int *target, knn_heap_t *heap)
+{
+	if (lo >= hi)
+		return;
+
+	int k = flat->k;
+
+	if (hi - lo <= flat->bucket) {
+		COUNT(visited, hi - lo);
+		for (int i = lo; i < hi; i++) {
+			int *point = flat->coord + (size_t)i * k;
+			knn_push(heap, point, point_distance(point, target, k), &flat->k);
+		}
+		return;
+	}
+
+	int mid = lo + (hi - lo) / 2;
+	int *root = flat->coord + (size_t)mid * k;
+
+	COUNT(visited, 1);
+	knn_push(heap, root, point_distance(root, target, k), &flat->k);
+
+	/**
+	 * The other side is skipped only if there are enough candidates and
+	 * the splitting plane is farther than the K-th of them
+	 */
+	int axis = depth % k;
+	dist_t plane = square_gap(target[axis], root[axis]);
+	if (target[axis] < root[axis]) {
+		flat_knn_range(flat, lo, mid, depth + 1, target, heap);
+		if (heap->size < heap->capacity || plane <= heap->dist[0])
+			flat_knn_range(flat, mid + 1, hi, depth + 1, target, heap);
+		else
+			COUNT(pruned, 1);
+	} else {
+		flat_knn_range(flat, mid + 1, hi, depth + 1, target, heap);
+		if (heap->size < heap->capacity || plane <= heap->dist[0])
+			flat_knn_range(flat, lo, mid, depth + 1, target, heap);
+		else
+			COUNT(pruned, 1);
+	}
+}
+
+int flat_knn(flat_t *flat, int *target, int count, int **result)
+{
+	if (count > flat->size)
+		count = flat->size;
+	if (count <= 0)
+		return 0;
+
+	knn_heap_t heap;
+	knn_heap_init(&heap, count);
+	flat_knn_range(flat, 0, flat->size, 0, target, &heap);
+
+	return knn_heap_sort(&heap, result, &flat->k);
+}
+
+static void flat_rs_range(flat_t *flat, int lo, int hi, int depth,
+						  int *start, int *end, rs_callback_t callback,
+						  void *data)
+{
+	if (lo >= hi)
+		return;
+
+	int k = flat->k;
+
+	if (hi - lo <= flat->bucket) {
+		COUNT(visited, hi - lo);
+		for (int i = hi - 1; i >= lo; i--) {
+			int *point = flat->coord + (size_t)i * k;
+			if (point_inside(point, start, end, k))
+				callback(point, &flat->k, data);
+		}
+		return;
+	}
+
+	int mid = lo + (hi - lo) / 2;
+	int *root = flat->coord + (size_t)mid * k;
+	int axis = depth % k;
+	COUNT(visited, 1);
+
+	if (end[axis] >= root[axis])
+		flat_rs_range(flat, mid + 1, hi, depth + 1, start, end, callback,
+					  data);
+	else
+		COUNT(pruned, 1);
+
+	if (point_inside(root, start, end, k))
+		callback(root, &flat->k, data);
+
+	if (start[axis] <= root[axis])
+		flat_rs_range(flat, lo, mid, depth + 1, start, end, callback, data);
+	else
+		COUNT(pruned, 1);
+}
+
+void flat_rs(flat_t *flat, int *start, int *end, rs_callback_t callback,
+			 void *data)
+{
+	flat_rs_range(flat, 0, flat->size, 0, start, end, callback, data);
+}
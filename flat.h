@@ -0,0 +1,145 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#ifndef FLAT_H
+#define FLAT_H
+
+#include "bst.h"
+
+#ifndef FLAT_BUCKET
+#define FLAT_BUCKET 8  // default number of points in a leaf
+#endif
+
+#define FLAT_MAGIC "KDTR"  // first bytes of a snapshot
+#define FLAT_VERSION 1  // layout of the snapshot
+#define FLAT_BYTE_ORDER 0x01020304  // read back differently on other endians
+
+/**
+ * Immutable k-d tree kept in a single array of coordinates. The points of
+ * the subtree covering the range [lo, hi) of the array have the root in the
+ * middle, at lo + (hi - lo) / 2, the left subtree before it and the right
+ * one after it, so the children are found by index and no pointers are kept.
+ *
+ * Ranges of at most bucket points are leaves and are scanned point by point,
+ * using AVX2 or SSE4.1 kernels when the build enables them (e.g. make
+ * SIMD=-mavx2) and plain loops otherwise.
+ */
+typedef struct flat_t flat_t;
+struct flat_t {
+	int *coord; /* coordinates of the points, k for each, in tree order */
+	int size; /* number of points in the tree */
+	int k; /* dimensions */
+	int bucket; /* maximum number of points in a leaf */
+	size_t mapped; /* bytes of the snapshot holding coord, 0 if allocated */
+};
+
+/**
+ * A snapshot is this header followed by the array of coordinates, in tree
+ * order, so the tree is searched straight from the mapped file.
+ */
+typedef struct flat_header_t flat_header_t;
+struct flat_header_t {
+	char magic[4]; /* FLAT_MAGIC */
+	unsigned int version; /* FLAT_VERSION */
+	unsigned int byte_order; /* FLAT_BYTE_ORDER */
+	int k; /* dimensions */
+	int size; /* number of points */
+	int bucket; /* maximum number of points in a leaf */
+};
+
+/**
+ * @brief The function returns a dynamically allocated flat tree
+ * holding all the points of the given k-d tree.
+ * 
+ * @param bst the bst
+ * @param k dimensions
+ * @param bucket maximum number of points in a leaf
+ * @return flat_t* the flat tree
+ */
+flat_t *flat_create(bst_t *bst, int *k, int bucket);
+
+/**
+ * @brief The function returns the number of levels of the flat tree,
+ * a leaf bucket counting as one.
+ * 
+ * @param flat the flat tree
+ * @return int the depth, 0 for an empty tree
+ */
+int flat_depth(flat_t *flat);
+
+/**
+ * @brief The function frees the memory used by a flat tree.
+ * 
+ * @param flat the flat tree
+ */
+void flat_free(flat_t *flat);
+
+/**
+ * @brief The function writes a snapshot of the flat tree, its header and
+ * then the array of coordinates as it is.
+ * 
+ * @param flat the flat tree
+ * @param filename the filename
+ */
+void flat_save(flat_t *flat, char *filename);
+
+/**
+ * @brief The function maps a snapshot saved by flat_save() read only and
+ * returns a flat tree searching the coordinates straight from the mapping,
+ * without allocating memory for the points.
+ * 
+ * @param filename the filename
+ * @return flat_t* the flat tree
+ */
+flat_t *flat_open(char *filename);
+
+/**
+ * @brief The function returns the coordinates of the nearest
+ * point to the target, or NULL if the tree is empty.
+ * 
+ * @param flat the flat tree
+ * @param target the target's coordinates
+ * @return int* the nearest point
+ */
+int *flat_nn(flat_t *flat, int *target);
+
+/**
+ * @brief The function returns a point within (1 + eps) of the distance
+ * of the nearest one, like ann() does for the bst. Every point compared
+ * is counted as visited, the ones of a leaf included.
+ * 
+ * @param flat the flat tree
+ * @param target the target's coordinates
+ * @param eps the allowed relative error, 0 for the exact nearest
+ * @param max_visited points visited at most, 0 for no limit
+ * @param visited the number of points visited
+ * @return int* the point found, NULL if the tree is empty
+ */
+int *flat_ann(flat_t *flat, int *target, double eps, int max_visited,
+			  int *visited);
+
+/**
+ * @brief The function finds the count nearest points to the target with
+ * the bounded heap of knn(), in the same order, without changing the tree.
+ * 
+ * @param flat the flat tree
+ * @param target the target's coordinates
+ * @param count how many neighbours are searched, at most the size
+ * @param result receives the coordinates of the neighbours, sorted by
+ * distance
+ * @return int how many neighbours were found
+ */
+int flat_knn(flat_t *flat, int *target, int count, int **result);
+
+/**
+ * @brief The function passes to the callback all the points within
+ * the given range, skipping the subtrees that can't overlap it.
+ * 
+ * @param flat the flat tree
+ * @param start the start
+ * @param end the end
+ * @param callback called for every point found
+ * @param data passed as it is to the callback
+ */
+void flat_rs(flat_t *flat, int *start, int *end, rs_callback_t callback,
+			 void *data);
+
+#endif /* FLAT_H */
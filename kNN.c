@@ -3,13 +3,93 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "bst.h"
+#include "counters.h"
+#include "kd.h"
+
+static void print_point(int *coord, int *k, void *data)
+{
+	(void)data;
+
+	for (int i = 0 ; i < *k; i++)
+		printf("%d ", coord[i]);
+	printf("\n");
+}
+
+/**
+ * Reads the integer left on the line of the command, if there is one.
+ * Otherwise returns the default value.
+ */
+static int read_optional(int value)
+{
+	int c;
+
+	do {
+		c = getchar();
+	} while (c == ' ' || c == '\t');
+
+	if (c == EOF)
+		return value;
+
+	ungetc(c, stdin);
+	if (c == '-' || (c >= '0' && c <= '9'))
+		scanf("%d", &value);
+
+	return value;
+}
+
+/**
+ * Reads the k coordinates of a point
+ */
+static int *read_point(int k)
+{
+	int *point = malloc((k > 0 ? k : 1) * sizeof(int));
+	DIE(!point, "Malloc for input_point failed");
+
+	for (int i = 0; i < k; i++)
+		scanf("%d", &point[i]);
+
+	return point;
+}
+
+/**
+ * Reads a file of queries, having the same format as the loaded ones,
+ * and prints the nearest point of each one, in their order
+ */
+static void nn_batch_file(kd_t *kd, char *filename)
+{
+	int n, dimensions;
+	int *queries = read_points(filename, &n, &dimensions);
+
+	/**
+	 * An empty tree has no nearest point, as for NN, whatever the
+	 * dimensions of the queries (before any LOAD they are 0)
+	 */
+	if (!kd_size(kd)) {
+		free(queries);
+		return;
+	}
+
+	INVALID(dimensions != kd->k,
+		"The queries have other dimensions than the tree");
+
+	int **result = malloc((n + 1) * sizeof(int *));
+	DIE(!result, "Malloc for batch result failed");
+
+	kd_nn_batch(kd, queries, n, result);
+
+	for (int i = 0; i < n; i++)
+		print_point(result[i], &kd->k, NULL);
+
+	free(result);
+	free(queries);
+}
 
 int main(void)
 {
-	int finish = 0, k;
+	int finish = 0;
 	char *command, *filename;
-	bst_t *bst = bst_create_tree();
+	kd_t *kd = kd_create();
+	counters_log_t log = {0};
 
 	/**
 	 *  As long as the exit string has not been received as input,
@@ -21,58 +101,115 @@ int main(void)
 	 */
 	while (!finish) {
 		scanf("%ms", &command);
+		COUNTERS_BEGIN(&log);
 
 		if (!strcmp(command, "LOAD")) {
 			scanf("%ms", &filename);
-			load_file(bst, filename, &k);
+			kd_load(kd, filename);
 			free(filename);
 
 		} else if (!strcmp(command, "NN")) {
-			int *input_point = malloc(k * sizeof(int));
-			DIE(!input_point, "Malloc for input_point failed");
+			int *input_point = read_point(kd->k);
+			int *nearest = kd_nn(kd, input_point);
+
+			if (nearest)
+				print_point(nearest, &kd->k, NULL);
+
+			free(input_point);
+
+		} else if (!strcmp(command, "ANN")) {
+			double eps;
+			scanf("%lf", &eps);
+
+			int *input_point = read_point(kd->k);
+			int max_visited = read_optional(0), visited;
+			int *found = kd_ann(kd, input_point, eps, max_visited, &visited);
+
+			if (found)
+				print_point(found, &kd->k, NULL);
+			printf("visited %d\n", visited);
+
+			free(input_point);
+
+		} else if (!strcmp(command, "NN_BATCH")) {
+			scanf("%ms", &filename);
+			nn_batch_file(kd, filename);
+			free(filename);
+
+		} else if (!strcmp(command, "KNN")) {
+			int count;
+			scanf("%d", &count);
 
-			for (int i = 0; i < k; i++)
-				scanf("%d", &input_point[i]);
+			/**
+			 * There can't be more neighbours than points
+			 */
+			if (count > kd_size(kd))
+				count = kd_size(kd);
 
-			node_t *target = bst_create_node(input_point, &k);
-			node_t *nearest = nn(bst->root, target, &k, 0);
+			int *input_point = read_point(kd->k);
+			int **neighbours = malloc((count > 0 ? count : 1) *
+									  sizeof(int *));
+			DIE(!neighbours, "Malloc for neighbours failed");
 
-			for (int i = 0 ; i < k; i++)
-				printf("%d ", nearest->coord[i]);
-			printf("\n");
+			int found = kd_knn(kd, input_point, count, neighbours);
+			for (int i = 0; i < found; i++)
+				print_point(neighbours[i], &kd->k, NULL);
 
-			free(target->coord);
-			free(target);
+			free(neighbours);
 			free(input_point);
 
 		} else if (!strcmp(command, "RS")) {
-			int *start = malloc(k * sizeof(int));
+			int *start = malloc(kd->k * sizeof(int));
 			DIE(!start, "Malloc for start range failed");
 
-			int *end = malloc(k * sizeof(int));
+			int *end = malloc(kd->k * sizeof(int));
 			DIE(!end, "Malloc for end rage failed");
 
-			int a = 0, b = 0;
-			for (int i = 0; i < 2 * k; i++) {
-				if (i % 2) {
-					scanf("%d", &end[a]);
-					a++;
-				} else {
-					scanf("%d", &start[b]);
-					b++;
-				}
-			}
+			for (int i = 0; i < kd->k; i++)
+				scanf("%d %d", &start[i], &end[i]);
 
-			rs(bst->root, start, end, 0, &k);
+			kd_rs(kd, start, end, print_point, NULL);
 
 			free(start);
 			free(end);
 
+		} else if (!strcmp(command, "INSERT")) {
+			int *input_point = read_point(kd->k);
+			kd_insert(kd, input_point);
+			free(input_point);
+
+		} else if (!strcmp(command, "DELETE")) {
+			int *input_point = read_point(kd->k);
+			kd_delete(kd, input_point);
+			free(input_point);
+
+		} else if (!strcmp(command, "INFO")) {
+			printf("size %d depth %d\n", kd_size(kd), kd_depth(kd));
+
+		} else if (!strcmp(command, "FREEZE")) {
+			kd_freeze(kd);
+
+		} else if (!strcmp(command, "SAVE")) {
+			scanf("%ms", &filename);
+			kd_save(kd, filename);
+			free(filename);
+
+		} else if (!strcmp(command, "OPEN")) {
+			scanf("%ms", &filename);
+			kd_open(kd, filename);
+			free(filename);
+
+		} else if (!strcmp(command, "STATS")) {
+			printf("size %d depth %d bytes %zu\n", kd_size(kd), kd_depth(kd),
+				   kd_bytes(kd));
+			counters_print(&log);
+
 		} else {
-			bst_free_tree(bst);
+			kd_free(kd);
 			finish = 1;
 		}
 
+		COUNTERS_END(&log, command);
 		free(command);
 	}
 	return 0;
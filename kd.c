@@ -0,0 +1,183 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "kd.h"
+
+kd_t *kd_create(void)
+{
+	kd_t *kd = malloc(sizeof(kd_t));
+	DIE(!kd, "Malloc for kd handle failed");
+
+	kd->bst = bst_create_tree();
+	kd->flat = NULL;
+	kd->k = 0;
+
+	return kd;
+}
+
+void kd_free(kd_t *kd)
+{
+	if (kd->flat)
+		flat_free(kd->flat);
+	bst_free_tree(kd->bst);
+	free(kd);
+}
+
+/**
+ * Moves the points of the flat tree back into the bst, which
+ * can be modified
+ */
+static void thaw(kd_t *kd)
+{
+	if (!kd->flat)
+		return;
+
+	bst_bulk_load(kd->bst, kd->flat->coord, kd->flat->size, &kd->k);
+	flat_free(kd->flat);
+	kd->flat = NULL;
+}
+
+void kd_load(kd_t *kd, char *filename)
+{
+	thaw(kd);
+	bst_load_file(kd->bst, filename, &kd->k);
+}
+
+void kd_insert(kd_t *kd, int *point)
+{
+	thaw(kd);
+	bst_insert_node(kd->bst, point, &kd->k);
+}
+
+int kd_delete(kd_t *kd, int *point)
+{
+	thaw(kd);
+	return bst_delete_node(kd->bst, point, &kd->k);
+}
+
+void kd_freeze(kd_t *kd)
+{
+	/**
+	 * The points are moved in a flat tree, which answers
+	 * the queries until the tree needs to be modified again
+	 */
+	if (kd->flat)
+		return;
+
+	kd->flat = flat_create(kd->bst, &kd->k, FLAT_BUCKET);
+	bst_free_tree(kd->bst);
+	kd->bst = bst_create_tree();
+}
+
+void kd_save(kd_t *kd, char *filename)
+{
+	/**
+	 * A snapshot always holds a flat tree, built for the
+	 * occasion if the points are in the bst
+	 */
+	if (kd->flat) {
+		flat_save(kd->flat, filename);
+		return;
+	}
+
+	flat_t *frozen = flat_create(kd->bst, &kd->k, FLAT_BUCKET);
+	flat_save(frozen, filename);
+	flat_free(frozen);
+}
+
+void kd_open(kd_t *kd, char *filename)
+{
+	if (kd->flat)
+		flat_free(kd->flat);
+	bst_free_tree(kd->bst);
+	kd->bst = bst_create_tree();
+
+	kd->flat = flat_open(filename);
+	kd->k = kd->flat->k;
+}
+
+int kd_size(kd_t *kd)
+{
+	return kd->flat ? kd->flat->size : kd->bst->size;
+}
+
+int kd_depth(kd_t *kd)
+{
+	return kd->flat ? flat_depth(kd->flat) : bst_depth(kd->bst->root);
+}
+
+size_t kd_bytes(kd_t *kd)
+{
+	if (!kd->flat)
+		return kd->bst->arena.bytes;
+	if (kd->flat->mapped)
+		return kd->flat->mapped;
+	return (size_t)kd->flat->size * kd->k * sizeof(int);
+}
+
+int *kd_nn(kd_t *kd, int *target)
+{
+	if (kd->flat)
+		return flat_nn(kd->flat, target);
+
+	node_t *nearest = nn(kd->bst->root, target, &kd->k, 0);
+	return nearest ? nearest->coord : NULL;
+}
+
+int *kd_ann(kd_t *kd, int *target, double eps, int max_visited,
+			int *visited)
+{
+	if (kd->flat)
+		return flat_ann(kd->flat, target, eps, max_visited, visited);
+
+	node_t *found = ann(kd->bst->root, target, eps, max_visited, &kd->k,
+						visited);
+	return found ? found->coord : NULL;
+}
+
+int kd_knn(kd_t *kd, int *target, int count, int **result)
+{
+	if (count > kd_size(kd))
+		count = kd_size(kd);
+	if (count <= 0)
+		return 0;
+
+	if (kd->flat)
+		return flat_knn(kd->flat, target, count, result);
+
+	return knn(kd->bst->root, target, count, &kd->k, result);
+}
+
+void kd_rs(kd_t *kd, int *start, int *end, rs_callback_t callback,
+		   void *data)
+{
+	if (kd->flat)
+		flat_rs(kd->flat, start, end, callback, data);
+	else
+		rs(kd->bst->root, start, end, 0, &kd->k, callback, data);
+}
+
+static void kd_points_add(int *coord, int *k, void *data)
+{
+	kd_points_t *points = data;
+
+	if (points->count < points->capacity)
+		memcpy(points->coord + (size_t)points->count * *k, coord,
+			   *k * sizeof(int));
+	points->count++;
+}
+
+int kd_range(kd_t *kd, int *start, int *end, kd_points_t *points)
+{
+	points->count = 0;
+	kd_rs(kd, start, end, kd_points_add, points);
+
+	return points->count;
+}
+
+void kd_nn_batch(kd_t *kd, int *queries, int count, int **result)
+{
+	nn_batch(kd->bst, kd->flat, queries, count, &kd->k, result, 0);
+}
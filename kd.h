@@ -0,0 +1,196 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#ifndef KD_H
+#define KD_H
+
+#include "bst.h"
+#include "flat.h"
+
+/**
+ * Handle of a set of points, the API of the k-d tree for other programs.
+ * The points are kept in a bst while they change and in a flat tree after
+ * kd_freeze() or kd_open(); a change moves them back in the bst.
+ *
+ * The searches report points through pointers to their coordinates inside
+ * the tree, so nothing is copied: a pointer stays valid until the points
+ * change. Searches may run in several threads at once as long as no
+ * function that changes the points runs meanwhile.
+ */
+typedef struct kd_t kd_t;
+struct kd_t {
+	bst_t *bst; /* the points while they can change */
+	flat_t *flat; /* the points after kd_freeze() or kd_open(), or NULL */
+	int k; /* dimensions, 0 before the first points */
+};
+
+/**
+ * Points found by a range search, copied one after another in an array of
+ * the caller, k coordinates each
+ */
+typedef struct kd_points_t kd_points_t;
+struct kd_points_t {
+	int *coord; /* memory of the caller */
+	int capacity; /* how many points fit in it */
+	int count; /* points found, more than capacity if some didn't fit */
+};
+
+/**
+ * @brief The function returns an empty set of points.
+ * 
+ * @return kd_t* 
+ */
+kd_t *kd_create(void);
+
+/**
+ * @brief The function frees the points and the handle.
+ * 
+ * @param kd the handle
+ */
+void kd_free(kd_t *kd);
+
+/**
+ * @brief The function adds the points of a file, see bst_load_file().
+ * 
+ * @param kd the handle
+ * @param filename the file
+ */
+void kd_load(kd_t *kd, char *filename);
+
+/**
+ * @brief The function adds a point.
+ * 
+ * @param kd the handle
+ * @param point its k coordinates
+ */
+void kd_insert(kd_t *kd, int *point);
+
+/**
+ * @brief The function removes a point.
+ * 
+ * @param kd the handle
+ * @param point its k coordinates
+ * @return int 1 if it was found, 0 otherwise
+ */
+int kd_delete(kd_t *kd, int *point);
+
+/**
+ * @brief The function moves the points in a flat tree, which searches
+ * faster and takes less memory, until they change again.
+ * 
+ * @param kd the handle
+ */
+void kd_freeze(kd_t *kd);
+
+/**
+ * @brief The function writes a snapshot of the points, see flat_save().
+ * 
+ * @param kd the handle
+ * @param filename the file
+ */
+void kd_save(kd_t *kd, char *filename);
+
+/**
+ * @brief The function replaces the points with the ones of a snapshot,
+ * searched straight from the mapped file.
+ * 
+ * @param kd the handle
+ * @param filename the file
+ */
+void kd_open(kd_t *kd, char *filename);
+
+/**
+ * @brief The function returns the number of points.
+ * 
+ * @param kd the handle
+ * @return int 
+ */
+int kd_size(kd_t *kd);
+
+/**
+ * @brief The function returns the number of levels of the tree.
+ * 
+ * @param kd the handle
+ * @return int 
+ */
+int kd_depth(kd_t *kd);
+
+/**
+ * @brief The function returns the bytes taken by the points: the arena
+ * of the bst, the array of a flat tree or its mapped snapshot.
+ * 
+ * @param kd the handle
+ * @return size_t 
+ */
+size_t kd_bytes(kd_t *kd);
+
+/**
+ * @brief The function returns the nearest point to the target.
+ * 
+ * @param kd the handle
+ * @param target its k coordinates
+ * @return int* the coordinates of the point, NULL if there are no points
+ */
+int *kd_nn(kd_t *kd, int *target);
+
+/**
+ * @brief The function returns a point within (1 + eps) of the distance
+ * of the nearest one, see ann().
+ * 
+ * @param kd the handle
+ * @param target its k coordinates
+ * @param eps the allowed relative error
+ * @param max_visited nodes visited at most, 0 for no limit
+ * @param visited the number of nodes visited
+ * @return int* the coordinates of the point, NULL if there are no points
+ */
+int *kd_ann(kd_t *kd, int *target, double eps, int max_visited,
+			int *visited);
+
+/**
+ * @brief The function finds the count nearest points to the target,
+ * sorted by distance.
+ * 
+ * @param kd the handle
+ * @param target its k coordinates
+ * @param count how many points, at most kd_size()
+ * @param result count pointers of the caller, to the coordinates
+ * @return int the number of points found
+ */
+int kd_knn(kd_t *kd, int *target, int count, int **result);
+
+/**
+ * @brief The function passes every point inside [start, end] to the
+ * callback.
+ * 
+ * @param kd the handle
+ * @param start the lower corner of the range
+ * @param end the upper corner of the range
+ * @param callback receives every point
+ * @param data passed to the callback
+ */
+void kd_rs(kd_t *kd, int *start, int *end, rs_callback_t callback,
+		   void *data);
+
+/**
+ * @brief The function copies the points inside [start, end] in the array
+ * of the caller, as many as fit, and counts all of them.
+ * 
+ * @param kd the handle
+ * @param start the lower corner of the range
+ * @param end the upper corner of the range
+ * @param points the array, its capacity set by the caller
+ * @return int the number of points inside the range
+ */
+int kd_range(kd_t *kd, int *start, int *end, kd_points_t *points);
+
+/**
+ * @brief The function finds the nearest point to every query, using a
+ * thread per core, see nn_batch().
+ * 
+ * @param kd the handle
+ * @param queries count queries, k coordinates each
+ * @param count number of queries
+ * @param result count pointers of the caller, to the coordinates
+ */
+void kd_nn_batch(kd_t *kd, int *queries, int count, int **result);
+
+#endif /* KD_H */
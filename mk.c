@@ -2,14 +2,148 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "counters.h"
+#include "pipeline.h"
 #include "trie.h"
 
-int main(void)
+/**
+ * Reads the integer left on the line of the command, if there is one.
+ * Otherwise returns the default value.
+ */
+static int read_optional(int value)
 {
-	int exit = 0, k, criterion;
-	char *command, *word, *filename, *prefix;
+	int c;
+
+	do {
+		c = getchar();
+	} while (c == ' ' || c == '\t');
+
+	if (c == EOF)
+		return value;
+
+	ungetc(c, stdin);
+	if (c == '-' || (c >= '0' && c <= '9'))
+		scanf("%d", &value);
+
+	return value;
+}
+
+/**
+ * Displays a word found by a search
+ */
+static void print_word(const char *word, void *data)
+{
+	pipeline_print(data, word);
+}
+
+/**
+ * Runs a command, adding its answer to the output. Returns 1 if the
+ * command ends the program
+ */
+static int execute(trie_t **trie, pipeline_command_t *command, char *word,
+				   pipeline_output_t *output, counters_log_t *log)
+{
+	int exit = 0;
+	COUNTERS_BEGIN(log);
+
+	if (command->type == PIPELINE_INSERT) {
+		trie_insert(*trie, word);
+
+	} else if (command->type == PIPELINE_LOAD) {
+		trie_load_file(*trie, word);
+
+	} else if (command->type == PIPELINE_SAVE) {
+		trie_save(*trie, word);
+
+	} else if (command->type == PIPELINE_OPEN) {
+		trie_free(trie);
+		*trie = trie_open(word);
+
+	} else if (command->type == PIPELINE_REMOVE) {
+		trie_remove(*trie, word);
+
+	} else if (command->type == PIPELINE_AUTOCORRECT) {
+		if (!autocorrect(*trie, word, command->number[0], command->number[1],
+						 print_word, output))
+			pipeline_print(output, "No words found");
+
+	} else if (command->type == PIPELINE_AUTOCOMPLETE) {
+		int criterion = command->number[0];
+
+		/**
+		 * Criterion 0 gives the words of all three criteria, and no
+		 * words are asked for when N isn't positive
+		 */
+		for (int c = 1; c <= 3 && command->number[1] > 0; c++) {
+			if ((criterion == c || !criterion) &&
+				!autocomplete(*trie, word, c, command->number[1], print_word,
+							  output))
+				pipeline_print(output, "No words found");
+		}
+
+	} else if (command->type == PIPELINE_STATS) {
+		pipeline_flush(output);
+		printf("words %d nodes %d depth %d bytes %zu\n", (*trie)->size,
+			   (*trie)->nodes, trie_depth(*trie),
+			   (size_t)(*trie)->capacity * sizeof(trie_node_t));
+		counters_print(log);
+
+	} else {
+		trie_free(trie);
+		exit = 1;
+	}
+
+	COUNTERS_END(log, pipeline_name(command->type));
+	return exit;
+}
+
+/**
+ * Runs the commands as a parser thread reads them from stdin in large
+ * blocks, gathering the answers in the output
+ */
+static void run_pipeline(trie_t **trie, pipeline_output_t *output,
+						 counters_log_t *log)
+{
+	pipeline_t *pipeline = pipeline_start(STDIN_FILENO);
+	pipeline_batch_t *batch;
+	int exit = 0;
+
+	while (!exit && (batch = pipeline_next(pipeline))) {
+		for (int i = 0; i < batch->count && !exit; i++) {
+			pipeline_command_t *command = &batch->command[i];
+			exit = execute(trie, command, batch->text + command->word,
+						   output, log);
+		}
+
+		pipeline_release(pipeline);
+	}
+
+	/**
+	 * The input ended without EXIT
+	 */
+	if (!exit)
+		trie_free(trie);
+
+	pipeline_stop(pipeline);
+	pipeline_flush(output);
+}
+
+int main(int argc, char **argv)
+{
+	static pipeline_output_t output;
 	trie_t *trie = trie_create();
+	counters_log_t log = {0};
+
+	if (argc > 1 && !strcmp(argv[1], "--pipeline")) {
+		run_pipeline(&trie, &output, &log);
+		return 0;
+	}
+
+	int exit = 0;
+	char *name, *word;
+	pipeline_command_t command;
 
 	/**
 	 *  As long as the exit string has not been received as input,
@@ -20,39 +154,27 @@ int main(void)
 	 *  to dynamically allocate them until space.
 	 */
 	while (!exit) {
-		scanf("%ms", &command);
+		command.type = PIPELINE_EXIT;
+		if (scanf("%ms", &name) == 1) {
+			command.type = pipeline_type(name, strlen(name));
+			free(name);
+		}
 
-		if (!strcmp(command, "INSERT")) {
+		word = NULL;
+		if (command.type != PIPELINE_STATS && command.type != PIPELINE_EXIT)
 			scanf("%ms", &word);
-			trie_insert(trie, word);
-			free(word);
 
-		} else if (!strcmp(command, "LOAD")) {
-			scanf("%ms", &filename);
-			load_file(trie, filename);
-			free(filename);
-
-		} else if (!strcmp(command, "REMOVE")) {
-			scanf("%ms", &word);
-			trie_remove(trie, word);
-			free(word);
-
-		} else if (!strcmp(command, "AUTOCORRECT")) {
-			scanf("%ms %d", &word, &k);
-			autocorrect(trie, word, k);
-			free(word);
-
-		} else if (!strcmp(command, "AUTOCOMPLETE")) {
-			scanf("%ms %d", &prefix, &criterion);
-			autocomplete(trie, prefix, criterion);
-			free(prefix);
-
-		} else {
-			trie_free(&trie);
-			exit = 1;
+		if (command.type == PIPELINE_AUTOCORRECT) {
+			scanf("%d", &command.number[0]);
+			command.number[1] = read_optional(0);
+		} else if (command.type == PIPELINE_AUTOCOMPLETE) {
+			scanf("%d", &command.number[0]);
+			command.number[1] = read_optional(1);
 		}
 
-		free(command);
+		exit = execute(&trie, &command, word, &output, &log);
+		pipeline_flush(&output);
+		free(word);
 	}
 
 	return 0;
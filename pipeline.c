@@ -0,0 +1,313 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pipeline.h"
+
+static const char *names[PIPELINE_TYPES] = {
+	"EXIT", "INSERT", "REMOVE", "LOAD", "SAVE", "OPEN", "AUTOCORRECT",
+	"AUTOCOMPLETE", "STATS"
+};
+
+int pipeline_type(const char *name, size_t len)
+{
+	/**
+	 * The first letter tells most of the names apart without measuring them
+	 */
+	for (int type = 1; type < PIPELINE_TYPES; type++) {
+		if (len && names[type][0] == name[0] && strlen(names[type]) == len &&
+			!memcmp(names[type], name, len))
+			return type;
+	}
+
+	return PIPELINE_EXIT;
+}
+
+const char *pipeline_name(int type)
+{
+	return names[type];
+}
+
+static int is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/**
+ * Reads the integer that follows on the line, if there is one, moving the
+ * position after it. Otherwise returns the default value.
+ */
+static int parse_number(const char *line, size_t *i, size_t len, int value)
+{
+	while (*i < len && is_blank(line[*i]))
+		(*i)++;
+
+	if (*i == len || (line[*i] != '-' && (line[*i] < '0' || line[*i] > '9')))
+		return value;
+
+	int sign = 1;
+	if (line[*i] == '-') {
+		sign = -1;
+		(*i)++;
+	}
+
+	value = 0;
+	while (*i < len && line[*i] >= '0' && line[*i] <= '9')
+		value = value * 10 + line[(*i)++] - '0';
+
+	return sign * value;
+}
+
+/**
+ * Waits for a batch the executor gave back and empties it
+ */
+static pipeline_batch_t *parser_batch(pipeline_t *pipeline)
+{
+	pthread_mutex_lock(&pipeline->lock);
+	while (pipeline->parsed - pipeline->taken == PIPELINE_BATCHES)
+		pthread_cond_wait(&pipeline->emptied, &pipeline->lock);
+	pthread_mutex_unlock(&pipeline->lock);
+
+	pipeline_batch_t *batch =
+		&pipeline->batch[pipeline->parsed % PIPELINE_BATCHES];
+	batch->count = 0;
+	batch->used = 0;
+
+	return batch;
+}
+
+static void parser_publish(pipeline_t *pipeline)
+{
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->parsed++;
+	pthread_cond_signal(&pipeline->filled);
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+/**
+ * Adds the command of a line to the batch, starting another batch when it
+ * is full. Returns 1 if the command ends the input
+ */
+static int parse_line(pipeline_t *pipeline, pipeline_batch_t **current,
+					  const char *line, size_t len)
+{
+	pipeline_batch_t *batch = *current;
+	size_t i = 0;
+
+	while (i < len && is_blank(line[i]))
+		i++;
+	if (i == len)
+		return 0;
+
+	size_t j = i;
+	while (j < len && !is_blank(line[j]))
+		j++;
+
+	int type = pipeline_type(line + i, j - i);
+
+	/**
+	 * Every command but STATS and EXIT is followed by a word
+	 */
+	size_t word = j, word_len = 0;
+	if (type != PIPELINE_STATS && type != PIPELINE_EXIT) {
+		while (word < len && is_blank(line[word]))
+			word++;
+		for (j = word; j < len && !is_blank(line[j]); j++)
+			;
+		word_len = j - word;
+	}
+
+	if (batch->count == PIPELINE_COMMANDS ||
+		batch->used + word_len + 1 > batch->size) {
+		if (batch->count) {
+			parser_publish(pipeline);
+			batch = parser_batch(pipeline);
+			*current = batch;
+		}
+
+		if (word_len + 1 > batch->size) {
+			batch->size = word_len + 1;
+			batch->text = realloc(batch->text, batch->size);
+			DIE(!batch->text, "Realloc for pipeline words failed");
+		}
+	}
+
+	pipeline_command_t *command = &batch->command[batch->count++];
+	command->type = type;
+	command->word = batch->used;
+	memcpy(batch->text + batch->used, line + word, word_len);
+	batch->text[batch->used + word_len] = '\0';
+	batch->used += word_len + 1;
+
+	/**
+	 * The same defaults as the commands read from a terminal: no mode
+	 * for AUTOCORRECT and one word for AUTOCOMPLETE
+	 */
+	command->number[0] = parse_number(line, &j, len, 0);
+	command->number[1] = parse_number(line, &j, len,
+									  type == PIPELINE_AUTOCOMPLETE);
+
+	return type == PIPELINE_EXIT;
+}
+
+static void *pipeline_parse(void *arg)
+{
+	pipeline_t *pipeline = arg;
+	size_t size = PIPELINE_BLOCK, start = 0, end = 0;
+	int eof = 0, last = 0;
+
+	char *block = malloc(size);
+	DIE(!block, "Malloc for pipeline input failed");
+
+	pipeline_batch_t *batch = parser_batch(pipeline);
+
+	while (!last) {
+		char *newline = memchr(block + start, '\n', end - start);
+
+		/**
+		 * Reads another block after the part of a line left, growing
+		 * the buffer when a single line fills it
+		 */
+		if (!newline && !eof) {
+			memmove(block, block + start, end - start);
+			end -= start;
+			start = 0;
+
+			if (end == size) {
+				size *= 2;
+				block = realloc(block, size);
+				DIE(!block, "Realloc for pipeline input failed");
+			}
+
+			ssize_t bytes = read(pipeline->fd, block + end, size - end);
+			if (bytes < 0 && errno == EINTR)
+				continue;
+			DIE(bytes < 0, "Reading the commands failed");
+
+			if (bytes)
+				end += bytes;
+			else
+				eof = 1;
+			continue;
+		}
+
+		if (!newline && start == end)
+			break;
+
+		size_t line_end = newline ? (size_t)(newline - block) : end;
+		last = parse_line(pipeline, &batch, block + start, line_end - start);
+		start = newline ? line_end + 1 : end;
+	}
+
+	if (batch->count)
+		parser_publish(pipeline);
+
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->done = 1;
+	pthread_cond_signal(&pipeline->filled);
+	pthread_mutex_unlock(&pipeline->lock);
+
+	free(block);
+	return NULL;
+}
+
+pipeline_t *pipeline_start(int fd)
+{
+	pipeline_t *pipeline = malloc(sizeof(pipeline_t));
+	DIE(!pipeline, "Malloc for pipeline failed");
+
+	pipeline->fd = fd;
+	pipeline->parsed = 0;
+	pipeline->taken = 0;
+	pipeline->done = 0;
+
+	for (int i = 0; i < PIPELINE_BATCHES; i++) {
+		pipeline_batch_t *batch = &pipeline->batch[i];
+		batch->command = malloc(PIPELINE_COMMANDS *
+								sizeof(pipeline_command_t));
+		DIE(!batch->command, "Malloc for pipeline commands failed");
+
+		batch->size = PIPELINE_TEXT;
+		batch->text = malloc(batch->size);
+		DIE(!batch->text, "Malloc for pipeline words failed");
+	}
+
+	pthread_mutex_init(&pipeline->lock, NULL);
+	pthread_cond_init(&pipeline->filled, NULL);
+	pthread_cond_init(&pipeline->emptied, NULL);
+
+	int err = pthread_create(&pipeline->parser, NULL, pipeline_parse,
+							 pipeline);
+	DIE(err, "Creating the pipeline parser failed");
+
+	return pipeline;
+}
+
+pipeline_batch_t *pipeline_next(pipeline_t *pipeline)
+{
+	pthread_mutex_lock(&pipeline->lock);
+	while (pipeline->taken == pipeline->parsed && !pipeline->done)
+		pthread_cond_wait(&pipeline->filled, &pipeline->lock);
+
+	int empty = pipeline->taken == pipeline->parsed;
+	pthread_mutex_unlock(&pipeline->lock);
+
+	if (empty)
+		return NULL;
+
+	return &pipeline->batch[pipeline->taken % PIPELINE_BATCHES];
+}
+
+void pipeline_release(pipeline_t *pipeline)
+{
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->taken++;
+	pthread_cond_signal(&pipeline->emptied);
+	pthread_mutex_unlock(&pipeline->lock);
+}
+
+void pipeline_stop(pipeline_t *pipeline)
+{
+	pthread_join(pipeline->parser, NULL);
+
+	for (int i = 0; i < PIPELINE_BATCHES; i++) {
+		free(pipeline->batch[i].command);
+		free(pipeline->batch[i].text);
+	}
+
+	pthread_mutex_destroy(&pipeline->lock);
+	pthread_cond_destroy(&pipeline->filled);
+	pthread_cond_destroy(&pipeline->emptied);
+	free(pipeline);
+}
+
+void pipeline_print(pipeline_output_t *output, const char *line)
+{
+	size_t len = strlen(line);
+
+	if (output->used + len + 1 > PIPELINE_OUTPUT) {
+		pipeline_flush(output);
+
+		if (len + 1 > PIPELINE_OUTPUT) {
+			fwrite(line, 1, len, stdout);
+			putchar('\n');
+			return;
+		}
+	}
+
+	memcpy(output->buffer + output->used, line, len);
+	output->buffer[output->used + len] = '\n';
+	output->used += len + 1;
+}
+
+void pipeline_flush(pipeline_output_t *output)
+{
+	fwrite(output->buffer, 1, output->used, stdout);
+	output->used = 0;
+}
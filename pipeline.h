@@ -0,0 +1,146 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "utils.h"
+
+#define PIPELINE_BLOCK (1 << 20)  // bytes read at once from the input
+#define PIPELINE_COMMANDS 4096  // commands parsed in a batch
+#define PIPELINE_TEXT (1 << 16)  // bytes of the words of a batch
+#define PIPELINE_BATCHES 4  // batches between the parser and the executor
+#define PIPELINE_OUTPUT (1 << 20)  // bytes of answers written at once
+
+/**
+ * The commands of mk. Any other command ends the input, as EXIT does
+ */
+#define PIPELINE_EXIT 0
+#define PIPELINE_INSERT 1
+#define PIPELINE_REMOVE 2
+#define PIPELINE_LOAD 3
+#define PIPELINE_SAVE 4
+#define PIPELINE_OPEN 5
+#define PIPELINE_AUTOCORRECT 6
+#define PIPELINE_AUTOCOMPLETE 7
+#define PIPELINE_STATS 8
+#define PIPELINE_TYPES 9
+
+/**
+ * A parsed command
+ */
+typedef struct pipeline_command_t pipeline_command_t;
+struct pipeline_command_t {
+	int type; // PIPELINE_INSERT, ...
+	size_t word; // offset of its word, prefix or file in the text
+	int number[2]; // k and mode, or criterion and n
+};
+
+/**
+ * Commands parsed one after another, with their words kept in the text
+ */
+typedef struct pipeline_batch_t pipeline_batch_t;
+struct pipeline_batch_t {
+	pipeline_command_t *command;
+	int count; // commands parsed
+	char *text; // the words, each one ending with '\0'
+	size_t used; // bytes taken by the words
+	size_t size; // bytes of the text
+};
+
+/**
+ * A thread parsing the input while the calling thread runs the commands
+ * parsed before, the batches going around a ring
+ */
+typedef struct pipeline_t pipeline_t;
+struct pipeline_t {
+	int fd; // the input
+	pipeline_batch_t batch[PIPELINE_BATCHES];
+	long parsed; // batches filled by the parser
+	long taken; // batches given back by the executor
+	int done; // 1 once the parser reached the end of the commands
+
+	pthread_mutex_t lock; // guards parsed, taken and done
+	pthread_cond_t filled; // signaled when a batch is parsed
+	pthread_cond_t emptied; // signaled when a batch is given back
+	pthread_t parser;
+};
+
+/**
+ * Answers gathered in memory and written at once
+ */
+typedef struct pipeline_output_t pipeline_output_t;
+struct pipeline_output_t {
+	char buffer[PIPELINE_OUTPUT];
+	size_t used; // bytes waiting to be written
+};
+
+/**
+ * @brief The function returns the command having the given name.
+ *
+ * @param name the name, not necessarily ending with '\0'
+ * @param len its length
+ * @return int PIPELINE_INSERT, ..., PIPELINE_EXIT if it's unknown
+ */
+int pipeline_type(const char *name, size_t len);
+
+/**
+ * @brief The function returns the name of a command.
+ *
+ * @param type the command
+ * @return const char*
+ */
+const char *pipeline_name(int type);
+
+/**
+ * @brief The function starts a thread parsing the commands of the input,
+ * until EXIT, an unknown command or its end.
+ *
+ * @param fd the input
+ * @return pipeline_t*
+ */
+pipeline_t *pipeline_start(int fd);
+
+/**
+ * @brief The function waits for the next batch of commands, in the order
+ * of the input.
+ *
+ * @param pipeline the pipeline
+ * @return pipeline_batch_t* the batch, NULL after the last one
+ */
+pipeline_batch_t *pipeline_next(pipeline_t *pipeline);
+
+/**
+ * @brief The function gives a batch back to the parser, once its
+ * commands and words are no longer needed.
+ *
+ * @param pipeline the pipeline
+ */
+void pipeline_release(pipeline_t *pipeline);
+
+/**
+ * @brief The function waits for the parser to finish and frees the
+ * pipeline.
+ *
+ * @param pipeline the pipeline
+ */
+void pipeline_stop(pipeline_t *pipeline);
+
+/**
+ * @brief The function adds a line to the output, writing it to stdout
+ * when the buffer fills.
+ *
+ * @param output the output
+ * @param line the line, without '\n'
+ */
+void pipeline_print(pipeline_output_t *output, const char *line);
+
+/**
+ * @brief The function writes the output gathered so far to stdout.
+ *
+ * @param output the output
+ */
+void pipeline_flush(pipeline_output_t *output);
+
+#endif /* PIPELINE_H */
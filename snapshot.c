@@ -0,0 +1,44 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+
+FILE *snapshot_create(const char *filename, char **temp)
+{
+	/**
+	 * In the same directory, so the rename doesn't cross file systems,
+	 * and named after the process, so two of them don't share it
+	 */
+	size_t len = strlen(filename) + 32;
+	*temp = malloc(len);
+	DIE(!*temp, "Malloc for snapshot name failed");
+	snprintf(*temp, len, "%s.%ld.tmp", filename, (long)getpid());
+
+	int fd = open(*temp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	DIE(fd < 0, "Can't create the snapshot");
+
+	FILE *out = fdopen(fd, "wb");
+	DIE(!out, "Can't create the snapshot");
+
+	return out;
+}
+
+void snapshot_commit(FILE *out, char *temp, const char *filename)
+{
+	/**
+	 * The data reaches the disk before the rename, so a crash leaves
+	 * either the old snapshot or the new one, never a partial file
+	 */
+	DIE(fflush(out), "Can't write the snapshot");
+	DIE(fsync(fileno(out)), "Can't write the snapshot");
+	DIE(fclose(out), "Can't write the snapshot");
+	DIE(rename(temp, filename), "Can't replace the snapshot");
+
+	free(temp);
+}
@@ -0,0 +1,35 @@
+/* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+
+#include "utils.h"
+
+/**
+ * A snapshot is written in a temporary file next to it and renamed over
+ * the old one once complete. The old file may still be mapped, by this
+ * process after OPEN or by others: renaming keeps its pages alive until
+ * they are unmapped, while truncating it would make them fault.
+ */
+
+/**
+ * @brief The function creates the temporary file a snapshot is written in.
+ *
+ * @param filename the snapshot
+ * @param temp set to the name of the temporary file, for snapshot_commit()
+ * @return FILE* the temporary file, open for writing
+ */
+FILE *snapshot_create(const char *filename, char **temp);
+
+/**
+ * @brief The function flushes the temporary file to the disk, closes it
+ * and renames it over the snapshot.
+ *
+ * @param out the temporary file
+ * @param temp its name, freed
+ * @param filename the snapshot
+ */
+void snapshot_commit(FILE *out, char *temp, const char *filename);
+
+#endif /* SNAPSHOT_H */
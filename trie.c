@@ -1,27 +1,165 @@
 /* Copyright 2023 < 312CA Dumitrascu Filip Teodor > */
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "counters.h"
+#include "snapshot.h"
 #include "trie.h"
 
-trie_node_t *trie_create_node(void)
+/**
+ * Puts memory that searches may still read aside, tagged with the current
+ * epoch, and advances the epoch. Searches starting from now on can't
+ * reach it any more.
+ */
+static void trie_retire(trie_t *trie, unsigned int node, trie_node_t *pool,
+						size_t mapped)
+{
+	if (trie->n_retired == trie->retired_capacity) {
+		trie->retired_capacity = trie->retired_capacity ?
+								 2 * trie->retired_capacity : 16;
+		trie->retired = realloc(trie->retired, trie->retired_capacity *
+								sizeof(trie_retired_t));
+		DIE(!trie->retired, "Realloc for retired memory failed");
+	}
+
+	trie_retired_t *retired = &trie->retired[trie->n_retired++];
+	retired->epoch = trie->epoch;
+	retired->node = node;
+	retired->pool = pool;
+	retired->mapped = mapped;
+
+	__atomic_add_fetch(&trie->epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Releases the retired memory that no running search can read: the one
+ * retired before the oldest search started
+ */
+static void trie_reclaim(trie_t *trie)
+{
+	if (!trie->n_retired)
+		return;
+
+	unsigned long oldest = ULONG_MAX;
+	for (int i = 0; i < TRIE_READERS; i++) {
+		unsigned long epoch = __atomic_load_n(&trie->readers[i].epoch,
+											  __ATOMIC_SEQ_CST);
+		if (epoch && epoch < oldest)
+			oldest = epoch;
+	}
+
+	int kept = 0;
+	for (int i = 0; i < trie->n_retired; i++) {
+		trie_retired_t *retired = &trie->retired[i];
+
+		if (retired->epoch >= oldest)
+			trie->retired[kept++] = *retired;
+		else if (!retired->pool)
+			trie_free_subtrie(trie, retired->node);
+		else if (retired->mapped)
+			munmap((char *)retired->pool - sizeof(trie_header_t),
+				   retired->mapped);
+		else
+			free(retired->pool);
+	}
+
+	trie->n_retired = kept;
+}
+
+void trie_read_begin(trie_t *trie, int reader)
 {
 	/**
-	 * Allocates space defensively for the node
-	 * and assigns each field of the stucture
+	 * The epoch is published before any node is read (the exchange is a
+	 * full barrier), so whatever is retired from this epoch on is kept
+	 * until the search ends
 	 */
-	trie_node_t *node = malloc(sizeof(trie_node_t));
-	DIE(!node, "Malloc for node allocation failed");
+	unsigned long epoch = __atomic_load_n(&trie->epoch, __ATOMIC_SEQ_CST);
+	__atomic_exchange_n(&trie->readers[reader].epoch, epoch,
+						__ATOMIC_SEQ_CST);
+}
 
-	node->end_of_word = 0;
-	node->n_children = 0;
+void trie_read_end(trie_t *trie, int reader)
+{
+	TRIE_WRITE(trie->readers[reader].epoch, 0);
+}
+
+unsigned int trie_create_node(trie_t *trie, char letter)
+{
+	unsigned int index;
+
+	/**
+	 * A released slot is reused first, so removing words doesn't leave
+	 * holes in the pool. Otherwise the pool is doubled when it's full,
+	 * so the nodes stay contiguous
+	 */
+	if (trie->free_list) {
+		index = trie->free_list;
+		trie->free_list = trie->pool[index].next;
+	} else {
+		if (trie->used == trie->capacity) {
+			trie->capacity = trie->capacity ? 2 * trie->capacity : 64;
+
+			/**
+			 * Searches may still be reading the old pool, so the nodes
+			 * are copied in a new one and the old one is retired. This
+			 * also moves the pool of an opened snapshot out of the mapping
+			 */
+			trie_node_t *pool = malloc(trie->capacity * sizeof(trie_node_t));
+			DIE(!pool, "Malloc for node pool failed");
+
+			trie_node_t *old = trie->pool;
+			size_t old_mapped = trie->mapped;
+			if (old)
+				memcpy(pool, old, trie->used * sizeof(trie_node_t));
+
+			trie->mapped = 0;
+			TRIE_WRITE(trie->pool, pool);
+
+			/**
+			 * Retired only after the new pool is published: a search
+			 * starting in the epoch advanced by trie_retire() must not
+			 * find the old one
+			 */
+			if (old)
+				trie_retire(trie, 0, old, old_mapped);
+		}
+		index = trie->used++;
+	}
+
+	trie_node_t *node = &trie->pool[index];
+
+	node->children = 0;
+	node->child = 0;
+	node->next = 0;
 	node->count_word = 0;
+	node->max_count = 0;
+	node->shortest = NO_WORD;
+	node->letter = letter;
+	node->end_of_word = 0;
 
-	node->children = calloc(ALPHABET_SIZE, sizeof(trie_node_t *));
-	DIE(!node->children, "Calloc for children allocation failed");
+	return index;
+}
 
-	return node;
+/**
+ * Prepares the fields shared by the writer and the searches
+ */
+static void trie_init_sync(trie_t *trie)
+{
+	pthread_mutex_init(&trie->lock, NULL);
+	trie->epoch = 1;
+	memset(trie->readers, 0, sizeof(trie->readers));
+	trie->retired = NULL;
+	trie->n_retired = 0;
+	trie->retired_capacity = 0;
 }
 
 trie_t *trie_create(void)
@@ -34,76 +172,249 @@ trie_t *trie_create(void)
 	DIE(!trie, "Malloc for trie allocation failed");
 
 	trie->size = 0;
-
-	trie->root = trie_create_node();
+	trie->pool = NULL;
+	trie->used = 0;
+	trie->capacity = 0;
+	trie->free_list = 0;
+	trie->mapped = 0;
+	trie_init_sync(trie);
+
+	trie_create_node(trie, 0);
 	trie->nodes = 1;
 
 	return trie;
 }
 
-void trie_insert(trie_t *trie, char *key)
+unsigned int trie_child(trie_t *trie, unsigned int node, int letter)
+{
+	trie_node_t *pool = TRIE_READ(trie->pool);
+
+	/**
+	 * The bitmap answers right away if there is no such child,
+	 * otherwise the sorted chain of siblings is walked. A writer links
+	 * a child before setting its bit and clears the bit before unlinking
+	 * it, but the chain is still walked until its end in case of a search
+	 * running meanwhile
+	 */
+	if (letter < 0 || letter >= ALPHABET_SIZE ||
+		!(TRIE_READ(pool[node].children) & (1u << letter)))
+		return 0;
+
+	unsigned int child = TRIE_READ(pool[node].child);
+	while (child && pool[child].letter != 'a' + letter)
+		child = TRIE_READ(pool[child].next);
+
+	return child;
+}
+
+/**
+ * Creates the child of a node for the given letter and links it
+ * in the chain of siblings, keeping it sorted
+ */
+static unsigned int trie_add_child(trie_t *trie, unsigned int node, int letter)
 {
-	trie_node_t *current = trie->root;
+	unsigned int child = trie_create_node(trie, 'a' + letter);
+	trie_node_t *pool = trie->pool;
+
+	unsigned int prev = 0, next = pool[node].child;
+	while (next && pool[next].letter < 'a' + letter) {
+		prev = next;
+		next = pool[next].next;
+	}
+
+	/**
+	 * The child is complete when it's linked
+	 */
+	pool[child].next = next;
+	if (prev)
+		TRIE_WRITE(pool[prev].next, child);
+	else
+		TRIE_WRITE(pool[node].child, child);
+
+	TRIE_WRITE(pool[node].children, pool[node].children | 1u << letter);
 
-	for (int i = 0; key[i] != '\0'; i++) { 
+	return child;
+}
+
+/**
+ * Takes out the child of a node for the given letter from
+ * the chain of siblings and returns it
+ */
+static unsigned int trie_unlink_child(trie_t *trie, unsigned int node,
+									  int letter)
+{
+	trie_node_t *pool = trie->pool;
+
+	unsigned int prev = 0, child = pool[node].child;
+	while (pool[child].letter != 'a' + letter) {
+		prev = child;
+		child = pool[child].next;
+	}
+
+	/**
+	 * The child keeps its next sibling, so a search standing on it
+	 * goes on through the rest of the chain
+	 */
+	TRIE_WRITE(pool[node].children, pool[node].children & ~(1u << letter));
+	if (prev)
+		TRIE_WRITE(pool[prev].next, pool[child].next);
+	else
+		TRIE_WRITE(pool[node].child, pool[child].next);
+
+	return child;
+}
+
+void trie_insert_len(trie_t *trie, const char *key, size_t len)
+{
+	unsigned int current = 0;
+
+	/**
+	 * The nodes of the path are kept to update their caches at the end,
+	 * on the stack for the usual words
+	 */
+	unsigned int stack_path[MAX_COMPLETE + 1];
+	unsigned int *path = stack_path;
+	if (len > MAX_COMPLETE) {
+		path = malloc((len + 1) * sizeof(unsigned int));
+		DIE(!path, "Malloc for insertion path failed");
+	}
+
+	for (size_t i = 0; i < len; i++) {
 		int letter = key[i] - 'a';
+		path[i] = current;
 
 		/**
 		 * If there is no node in the trie for this
 		 * letter a new one is allocated
 		 */
-		if (!current->children[letter]) {
-			current->children[letter] = trie_create_node();
+		unsigned int next = trie_child(trie, current, letter);
+		if (!next) {
+			next = trie_add_child(trie, current, letter);
 			trie->nodes++;
-			current->n_children++;
 		}
 
-		current = current->children[letter];
+		current = next;
 	}
 
+	path[len] = current;
+
 	/**
 	 * The word is finalized and counted both in the trie and in its counter
 	 */
-	if (!current->end_of_word) {
-		current->end_of_word = 1;
+	trie_node_t *pool = trie->pool;
+	TRIE_WRITE(pool[current].count_word, pool[current].count_word + 1);
+	if (!pool[current].end_of_word) {
+		TRIE_WRITE(pool[current].end_of_word, 1);
 		trie->size++;
 	}
 
-	current->count_word++;
+	/**
+	 * The word can only be nearer and more frequent than the cached ones,
+	 * so the caches are improved from the bottom of the path until a node
+	 * already has both. Going up, a search following a cache always finds
+	 * the word below
+	 */
+	int count = pool[current].count_word;
+	for (size_t i = len + 1; i-- > 0; ) {
+		trie_node_t *node = &pool[path[i]];
+		int changed = 0;
+
+		if (node->shortest > len - i) {
+			TRIE_WRITE(node->shortest, (unsigned short)(len - i));
+			changed = 1;
+		}
+		if (node->max_count < count) {
+			TRIE_WRITE(node->max_count, count);
+			changed = 1;
+		}
+
+		if (!changed)
+			break;
+	}
+
+	if (path != stack_path)
+		free(path);
 }
 
-void trie_free_subtrie(trie_t *trie, trie_node_t *node)
+void trie_insert(trie_t *trie, char *key)
 {
-	if (!node)
-		return;
+	/**
+	 * Only the words made of letters from a to z can be stored
+	 */
+	size_t len = 0;
+	for (; key[len] != '\0'; len++) {
+		if (key[len] < 'a' || key[len] > 'z')
+			return;
+	}
+
+	pthread_mutex_lock(&trie->lock);
+	trie_insert_len(trie, key, len);
+	trie_reclaim(trie);
+	pthread_mutex_unlock(&trie->lock);
+}
+
+int trie_update_cache(trie_t *trie, unsigned int node)
+{
+	trie_node_t *pool = trie->pool;
+
+	int max_count = pool[node].end_of_word ? pool[node].count_word : 0;
+	unsigned int shortest = pool[node].end_of_word ? 0 : NO_WORD;
+
+	for (unsigned int child = pool[node].child; child;
+		 child = pool[child].next) {
+		if (pool[child].max_count > max_count)
+			max_count = pool[child].max_count;
+		if (pool[child].shortest != NO_WORD &&
+			pool[child].shortest + 1u < shortest)
+			shortest = pool[child].shortest + 1u;
+	}
+
+	if (pool[node].max_count == max_count && pool[node].shortest == shortest)
+		return 0;
+
+	TRIE_WRITE(pool[node].max_count, max_count);
+	TRIE_WRITE(pool[node].shortest, (unsigned short)shortest);
+	return 1;
+}
 
+void trie_free_subtrie(trie_t *trie, unsigned int node)
+{
 	/**
 	 * Child by child of the node the whole subtree
-	 * of the node is freed recursively
+	 * of the node is released recursively
 	 */
-	for (int i = 0; i < ALPHABET_SIZE && node->n_children; i++) {
-		if (!node->children[i])
-			continue;
-
-		trie_free_subtrie(trie, node->children[i]);
-		node->n_children--;
-		node->children[i] = NULL;
+	unsigned int child = trie->pool[node].child;
+	while (child) {
+		unsigned int next = trie->pool[child].next;
+		trie_free_subtrie(trie, child);
+		child = next;
 	}
 
 	/**
-	 * Also, the node is freed
+	 * Also, the node is released in the free list of the pool
 	 */
-	free(node->children);
-	free(node);
+	trie->pool[node].children = 0;
+	trie->pool[node].child = 0;
+	trie->pool[node].next = trie->free_list;
+	trie->free_list = node;
 
 	trie->nodes--;
 }
 
-void trie_remove(trie_t *trie, char *key)
+/**
+ * Removes a word, the caller holding the lock of the trie
+ */
+static void trie_remove_word(trie_t *trie, char *key)
 {
-	trie_node_t *current = trie->root;
-	trie_node_t *parent = trie->root;
+	trie_node_t *pool = trie->pool;
+	unsigned int current = 0;
+	unsigned int parent = 0;
 	int parent_letter = (key[0] - 'a');
+	size_t parent_depth = 0;
+
+	size_t len = strlen(key);
+	unsigned int *path = malloc((len + 1) * sizeof(unsigned int));
+	DIE(!path, "Malloc for removal path failed");
 
 	/**
 	 * Iterates letter by letter of the word to
@@ -112,273 +423,908 @@ void trie_remove(trie_t *trie, char *key)
 	for (int i = 0; key[i] != '\0'; i++) {
 		int letter = key[i] - 'a';
 
-		if (!current->children[letter])
+		unsigned int next = trie_child(trie, current, letter);
+		if (!next) {
+			free(path);
 			return;
+		}
+
+		path[i] = current;
 
-		if (current->n_children > 1 || current->end_of_word) {
+		if (trie_n_children(&pool[current]) > 1 ||
+			pool[current].end_of_word) {
 			parent = current;
 			parent_letter = letter;
+			parent_depth = i;
 		}
 
-		current = current->children[letter];
+		current = next;
 	}
 
-	current->end_of_word = 0;
-	current->count_word = 0;
+	path[len] = current;
+
+	if (!pool[current].end_of_word) {
+		free(path);
+		return;
+	}
+
+	TRIE_WRITE(pool[current].end_of_word, 0);
+	TRIE_WRITE(pool[current].count_word, 0);
 
 	/**
 	 * If the word to be deleted is not a prefix for another word
-	 * is released from memory, otherwise set end_of_word to 0
+	 * is released from memory, otherwise set end_of_word to 0. Searches
+	 * may be standing in the unlinked nodes, so they are only retired
 	 */
-	if (!current->n_children) {
-		trie_free_subtrie(trie, parent->children[parent_letter]);
-		parent->children[parent_letter] = NULL;
-		parent->n_children--;
+	if (!pool[current].children)
+		trie_retire(trie, trie_unlink_child(trie, parent, parent_letter),
+					NULL, 0);
+
+	/**
+	 * The caches of the nodes left on the path are recomputed from the
+	 * bottom, as the best completion may have been this word. Once a
+	 * cache doesn't change, the ones above it don't either
+	 */
+	size_t last = pool[current].children ? len : parent_depth;
+	for (size_t i = last + 1; i-- > 0; ) {
+		if (!trie_update_cache(trie, path[i]))
+			break;
 	}
 
+	free(path);
 	trie->size--;
 }
 
+void trie_remove(trie_t *trie, char *key)
+{
+	pthread_mutex_lock(&trie->lock);
+	trie_remove_word(trie, key);
+	trie_reclaim(trie);
+	pthread_mutex_unlock(&trie->lock);
+}
+
 void trie_free(trie_t **ptrie)
 {
 	/**
-	 * The memory of the subtree formed by root and root is freed.
-	 * This frees the memory of the entire tree
+	 * All the nodes are in the pool, so freeing it
+	 * frees the memory of the entire tree
+	 */
+	trie_t *trie = *ptrie;
+
+	/**
+	 * No search runs any more, so the retired pools go as well
 	 */
-	trie_free_subtrie(*ptrie, (*ptrie)->root);
+	for (int i = 0; i < trie->n_retired; i++) {
+		trie_retired_t *retired = &trie->retired[i];
+
+		if (retired->mapped)
+			munmap((char *)retired->pool - sizeof(trie_header_t),
+				   retired->mapped);
+		else
+			free(retired->pool);
+	}
+	free(trie->retired);
+	pthread_mutex_destroy(&trie->lock);
+
+	if (trie->mapped)
+		munmap((char *)trie->pool - sizeof(trie_header_t), trie->mapped);
+	else
+		free(trie->pool);
 	free(*ptrie);
 }
 
-void load_file(trie_t *trie, char *filename)
+static int trie_depth_node(trie_t *trie, unsigned int node)
 {
-	FILE *in = fopen(filename, "rt");
-	DIE(!in, "Can't open the ascii file");
+	int depth = 0;
 
-	char word[MAX_COMPLETE];
-	while (!feof(in)) {
-		fscanf(in, "%s", word);
-		trie_insert(trie, word);
+	for (unsigned int child = trie->pool[node].child; child;
+		 child = trie->pool[child].next) {
+		int child_depth = 1 + trie_depth_node(trie, child);
+		if (child_depth > depth)
+			depth = child_depth;
 	}
 
-	fclose(in);
+	return depth;
+}
+
+int trie_depth(trie_t *trie)
+{
+	return trie_depth_node(trie, 0);
 }
 
-void dfs_autocorrect(trie_node_t *node, char *word, char *correct, int diff,
-					 int k, int *ok)
+/**
+ * Inserts every word of the buffer, the words being separated by white
+ * spaces. A word with characters outside a-z is skipped and counted.
+ * Returns where the last word starts if it may continue after the buffer.
+ */
+static size_t load_words(trie_t *trie, const char *data, size_t size,
+						 int last, size_t *skipped)
+{
+	size_t i = 0;
+
+	while (i < size) {
+		while (i < size && (data[i] == ' ' || data[i] == '\n' ||
+							data[i] == '\t' || data[i] == '\r'))
+			i++;
+
+		size_t start = i;
+		int valid = 1;
+
+		while (i < size && data[i] != ' ' && data[i] != '\n' &&
+			   data[i] != '\t' && data[i] != '\r') {
+			valid &= (unsigned char)(data[i] - 'a') < ALPHABET_SIZE;
+			i++;
+		}
+
+		if (i == start)
+			break;
+
+		/**
+		 * A word reaching the end of the block is left for the next one
+		 */
+		if (i == size && !last)
+			return start;
+
+		if (valid)
+			trie_insert_len(trie, data + start, i - start);
+		else
+			(*skipped)++;
+	}
+
+	return size;
+}
+
+void trie_load_file(trie_t *trie, char *filename)
+{
+	int fd = open(filename, O_RDONLY);
+	DIE(fd < 0, "Can't open the ascii file");
+
+	struct stat st;
+	DIE(fstat(fd, &st) < 0, "Can't stat the ascii file");
+
+	size_t skipped = 0;
+	pthread_mutex_lock(&trie->lock);
+
+	/**
+	 * The file is mapped and the words are inserted straight from
+	 * the mapping, without being copied
+	 */
+	void *data = MAP_FAILED;
+	if (st.st_size > 0)
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (data != MAP_FAILED) {
+		posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+		load_words(trie, data, st.st_size, 1, &skipped);
+		munmap(data, st.st_size);
+
+	} else {
+		/**
+		 * Files that can't be mapped are read in large blocks, the
+		 * unfinished word of a block being moved at the start
+		 */
+		size_t capacity = LOAD_BLOCK, used = 0;
+		char *block = malloc(capacity);
+		DIE(!block, "Malloc for load block failed");
+
+		while (1) {
+			if (used == capacity) {
+				capacity *= 2;
+				block = realloc(block, capacity);
+				DIE(!block, "Realloc for load block failed");
+			}
+
+			ssize_t bytes = read(fd, block + used, capacity - used);
+			DIE(bytes < 0, "Can't read the ascii file");
+
+			used += bytes;
+			size_t rest = load_words(trie, block, used, !bytes, &skipped);
+
+			memmove(block, block + rest, used - rest);
+			used -= rest;
+
+			if (!bytes)
+				break;
+		}
+
+		free(block);
+	}
+
+	trie_reclaim(trie);
+	pthread_mutex_unlock(&trie->lock);
+	close(fd);
+
+	if (skipped)
+		fprintf(stderr, "Skipped %zu words with characters outside a-z\n",
+				skipped);
+}
+
+void trie_save(trie_t *trie, char *filename)
+{
+	char *temp;
+	FILE *out = snapshot_create(filename, &temp);
+
+	/**
+	 * The writer is kept out while the pool is written
+	 */
+	pthread_mutex_lock(&trie->lock);
+
+	trie_header_t header = {
+		.magic = TRIE_MAGIC,
+		.version = TRIE_VERSION,
+		.byte_order = TRIE_BYTE_ORDER,
+		.node_size = sizeof(trie_node_t),
+		.used = trie->used,
+		.free_list = trie->free_list,
+		.size = trie->size,
+		.nodes = trie->nodes,
+	};
+
+	/**
+	 * The nodes only refer to each other by index, so the pool is
+	 * written as it is and stays valid wherever it's mapped
+	 */
+	DIE(fwrite(&header, sizeof(header), 1, out) != 1,
+		"Can't write the snapshot");
+	DIE(fwrite(trie->pool, sizeof(trie_node_t), trie->used, out) !=
+		trie->used, "Can't write the snapshot");
+	snapshot_commit(out, temp, filename);
+
+	pthread_mutex_unlock(&trie->lock);
+}
+
+trie_t *trie_open(char *filename)
+{
+	int fd = open(filename, O_RDONLY);
+	DIE(fd < 0, "Can't open the snapshot");
+
+	struct stat st;
+	DIE(fstat(fd, &st) < 0, "Can't stat the snapshot");
+	INVALID((size_t)st.st_size < sizeof(trie_header_t), "Invalid snapshot");
+
+	/**
+	 * A private mapping is shared with the page cache until a page
+	 * is written, which copies only that page
+	 */
+	char *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+					  fd, 0);
+	DIE(data == MAP_FAILED, "Can't map the snapshot");
+	close(fd);
+
+	trie_header_t *header = (trie_header_t *)data;
+	INVALID(memcmp(header->magic, TRIE_MAGIC, sizeof(header->magic)) ||
+		header->version != TRIE_VERSION, "Invalid snapshot");
+	INVALID(header->byte_order != TRIE_BYTE_ORDER ||
+		header->node_size != sizeof(trie_node_t),
+		"Snapshot saved on an incompatible machine");
+	INVALID(!header->used || (size_t)st.st_size != sizeof(trie_header_t) +
+		(size_t)header->used * sizeof(trie_node_t), "Truncated snapshot");
+
+	trie_t *trie = malloc(sizeof(trie_t));
+	DIE(!trie, "Malloc for trie allocation failed");
+
+	trie->pool = (trie_node_t *)(data + sizeof(trie_header_t));
+	trie->used = header->used;
+	trie->capacity = header->used;
+	trie->free_list = header->free_list;
+	trie->size = header->size;
+	trie->nodes = header->nodes;
+	trie->mapped = st.st_size;
+	trie_init_sync(trie);
+
+	return trie;
+}
+
+void trie_words_init(trie_words_t *words, char *buffer, size_t size)
+{
+	words->buffer = buffer;
+	words->size = size;
+	words->used = 0;
+	words->count = 0;
+	words->dropped = 0;
+}
+
+void trie_words_add(const char *word, void *data)
+{
+	trie_words_t *words = data;
+	size_t len = strlen(word) + 1;
+
+	if (words->used + len > words->size) {
+		words->dropped++;
+		return;
+	}
+
+	memcpy(words->buffer + words->used, word, len);
+	words->used += len;
+	words->count++;
+}
+
+/**
+ * Passes a word found by a search to the callback of the caller
+ */
+static void trie_report(trie_output_t *out, const char *word)
+{
+	out->callback(word, out->data);
+	out->found++;
+}
+
+void dfs_autocorrect(trie_t *trie, unsigned int node, const char *word,
+					 char *correct, int depth, int diff, int k,
+					 trie_output_t *out)
 {
 	/**
 	 * If there are more than k letters different
 	 * from word it exits the function
 	 */
 	if (diff > k) {
+		COUNT(pruned, 1);
 		return;
 	}
+	COUNT(visited, 1);
+
+	trie_node_t *pool = TRIE_READ(trie->pool);
 
 	/**
 	 * If in correct is a word with the same length as input word and if
 	 * the number of different letters is less than or equal to with k
-	 * and if the sequence of letters forming the word displays the word
+	 * and if the sequence of letters forming the word reports the word
 	 */
-	if (!strcmp(word, "")) {
-		if (diff <= k && node->end_of_word) {
-			printf("%s\n", correct);
-			*ok = 1;
+	if (word[depth] == '\0') {
+		if (diff <= k && TRIE_READ(pool[node].end_of_word)) {
+			correct[depth] = '\0';
+			trie_report(out, correct);
 		}
 		return;
 	}
 
-	int letter = *word - 'a';
-	for (int i = 0; i < ALPHABET_SIZE; i++) {
-		if (node->children[i]) {
-			/**
-			 * Puts a letter in the output word
-			 */
-			size_t len = strlen(correct);
-			correct[len] = 'a' + i;
-			correct[len + 1] = '\0';
+	for (unsigned int child = TRIE_READ(pool[node].child); child;
+		 child = TRIE_READ(pool[child].next)) {
+		/**
+		 * Puts a letter in the output word, at the depth of the child,
+		 * and recalls the function based on the matching letters
+		 */
+		correct[depth] = pool[child].letter;
 
-			/**
-			 * Recalls the function based on the matching letters
-			 */
-			dfs_autocorrect(node->children[i], word + 1, correct,
-							diff + (i != letter), k, ok);
+		dfs_autocorrect(trie, child, word, correct, depth + 1,
+						diff + (correct[depth] != word[depth]), k, out);
+	}
+}
+
+/**
+ * State of the edit distance search: one row of the Levenshtein table for
+ * every letter of the word being built
+ */
+typedef struct edit_search_t edit_search_t;
+struct edit_search_t {
+	trie_t *trie;
+	const char *word; // the word to be corrected
+	int len; // its length
+	int k; // maximum distance
+	int transpositions; // 1 if swapping two neighbour letters costs 1
+	int *rows; // (len + k + 2) rows of len + 1 distances
+	char *correct; // the word being built
+	trie_output_t *out; // where the words are reported
+};
+
+void dfs_edit(edit_search_t *search, unsigned int node, int depth)
+{
+	trie_node_t *pool = TRIE_READ(search->trie->pool);
+	int len = search->len;
+	int *prev = search->rows + (size_t)(depth - 1) * (len + 1);
+	int *row = prev + len + 1;
+	char letter = pool[node].letter;
+	COUNT(visited, 1);
 
-			correct[strlen(correct) - 1] = '\0';
+	/**
+	 * Distances between the word built so far and every prefix of the
+	 * input word, from the row of the parent: insertion, deletion or
+	 * substitution of the last letter, or the swap of the last two
+	 */
+	row[0] = depth;
+	int min = row[0];
+
+	for (int j = 1; j <= len; j++) {
+		int cost = search->word[j - 1] != letter;
+		int best = prev[j - 1] + cost;
+
+		if (prev[j] + 1 < best)
+			best = prev[j] + 1;
+		if (row[j - 1] + 1 < best)
+			best = row[j - 1] + 1;
+
+		if (search->transpositions && depth > 1 && j > 1 &&
+			letter == search->word[j - 2] &&
+			search->correct[depth - 2] == search->word[j - 1]) {
+			int *before = prev - (len + 1);
+			if (before[j - 2] + 1 < best)
+				best = before[j - 2] + 1;
 		}
+
+		row[j] = best;
+		if (best < min)
+			min = best;
+	}
+
+	if (row[len] <= search->k && TRIE_READ(pool[node].end_of_word)) {
+		search->correct[depth] = '\0';
+		trie_report(search->out, search->correct);
+	}
+
+	/**
+	 * The distances can only grow further down, so the subtree
+	 * is dropped when none of them is within k any more
+	 */
+	if (min > search->k) {
+		COUNT(pruned, 1);
+		return;
+	}
+
+	for (unsigned int child = TRIE_READ(pool[node].child); child;
+		 child = TRIE_READ(pool[child].next)) {
+		search->correct[depth] = pool[child].letter;
+		dfs_edit(search, child, depth + 1);
 	}
 }
 
-void autocorrect(trie_t *trie, char *word, int k)
+int autocorrect(trie_t *trie, const char *word, int k, int mode,
+				trie_callback_t callback, void *data)
 {
-	char *correct = malloc((strlen(word) + 1) * sizeof(char));
-	DIE(!correct, "Malloc for correct word allocation failed");
+	int len = strlen(word);
+	trie_output_t out = {callback, data, 0};
 
-	int ok = 0;
-	correct[0] = '\0';
-	dfs_autocorrect(trie->root, word, correct, 0, k, &ok);
+	/**
+	 * No word is within a negative distance, which would also size
+	 * the rows of the edit distance below the ones written
+	 */
+	if (k < 0)
+		return 0;
+
+	if (!mode) {
+		char *correct = malloc((len + 1) * sizeof(char));
+		DIE(!correct, "Malloc for correct word allocation failed");
 
-	if (!ok) {
-		printf("No words found\n");
+		dfs_autocorrect(trie, 0, word, correct, 0, 0, k, &out);
+
+		free(correct);
+		return out.found;
 	}
 
-	free(correct);
+	/**
+	 * A word within distance k has at most len + k letters, so
+	 * that many rows are needed besides the one of the root
+	 */
+	edit_search_t search;
+	search.trie = trie;
+	search.word = word;
+	search.len = len;
+	search.k = k;
+	search.transpositions = mode == 2;
+	search.out = &out;
+
+	search.rows = malloc((size_t)(len + k + 2) * (len + 1) * sizeof(int));
+	DIE(!search.rows, "Malloc for edit distance rows failed");
+
+	search.correct = malloc((len + k + 2) * sizeof(char));
+	DIE(!search.correct, "Malloc for correct word allocation failed");
+
+	for (int j = 0; j <= len; j++)
+		search.rows[j] = j;
+
+	trie_node_t *pool = TRIE_READ(trie->pool);
+	for (unsigned int child = TRIE_READ(pool[0].child); child;
+		 child = TRIE_READ(pool[child].next)) {
+		search.correct[0] = pool[child].letter;
+		dfs_edit(&search, child, 1);
+	}
+
+	free(search.correct);
+	free(search.rows);
+	return out.found;
+}
+
+/**
+ * Makes room in a buffer for a word of len letters, doubling it when it's
+ * too short
+ */
+static void trie_reserve(char **buffer, size_t *size, size_t len)
+{
+	if (len < *size)
+		return;
+
+	while (len >= *size)
+		*size = *size ? 2 * *size : MAX_COMPLETE;
+
+	*buffer = realloc(*buffer, *size);
+	DIE(!*buffer, "Realloc for completed word failed");
 }
 
-void dfs_lexico(trie_node_t *node, char *complete, int *ok)
+int dfs_lexico(trie_t *trie, unsigned int node, char **complete,
+			   size_t *size, int len, trie_output_t *out)
 {
 	/**
-	 *  If the word is found, it is displayed and no further
+	 *  If the word is found, it is reported and no further
 	 *  iteration of the children is entered
 	 */
-	if (node->end_of_word) {
-		*ok = 1;
-		printf("%s\n", complete);
-		return;
+	trie_node_t *pool = TRIE_READ(trie->pool);
+	COUNT(visited, 1);
+	if (TRIE_READ(pool[node].end_of_word)) {
+		(*complete)[len] = '\0';
+		trie_report(out, *complete);
+		return 1;
 	}
 
 	/**
 	 * Iterating through 'a' to 'z' everytime we search for the next letter,
 	 * knows for sure that the first word found is the smallest lexicographic
 	 */
-	for (int i = 0; i < ALPHABET_SIZE && !*ok; i++) {
-		if (node->children[i]) {
-			size_t len = strlen(complete);
-			complete[len] = 'a' + i;
-			complete[len + 1] = '\0';
+	for (unsigned int child = TRIE_READ(pool[node].child); child;
+		 child = TRIE_READ(pool[child].next)) {
+		trie_reserve(complete, size, len + 1);
+		(*complete)[len] = pool[child].letter;
+		if (dfs_lexico(trie, child, complete, size, len + 1, out))
+			return 1;
+	}
 
-			dfs_lexico(node->children[i], complete, ok);
+	return 0;
+}
+
+void complete_shortest(trie_t *trie, unsigned int node, char **complete,
+					   size_t *size)
+{
+	trie_node_t *pool = TRIE_READ(trie->pool);
+	size_t len = strlen(*complete);
 
-			complete[len] = '\0';
+	/**
+	 * Goes every time to the first child (in lexicographic order) having
+	 * the nearest word, until the node is that word. A search running
+	 * while the word is removed may find no children left
+	 */
+	while (TRIE_READ(pool[node].shortest)) {
+		unsigned int best = TRIE_READ(pool[node].child);
+		if (!best)
+			break;
+
+		for (unsigned int child = TRIE_READ(pool[best].next); child;
+			 child = TRIE_READ(pool[child].next)) {
+			if (TRIE_READ(pool[child].shortest) <
+				TRIE_READ(pool[best].shortest))
+				best = child;
 		}
+
+		trie_reserve(complete, size, len + 1);
+		(*complete)[len++] = pool[best].letter;
+		node = best;
+		COUNT(visited, 1);
 	}
+
+	(*complete)[len] = '\0';
 }
 
-void dfs_shortest(trie_node_t *node, char *complete, char *current,
-				  char *prefix)
+void complete_frequent(trie_t *trie, unsigned int node, char **complete,
+					   size_t *size)
 {
+	trie_node_t *pool = TRIE_READ(trie->pool);
+	size_t len = strlen(*complete);
+
 	/**
-	 * Firstly, puts in complete word the first word founded,
-	 * replacing the prefix and then assings the shortest one
-	 * in following recursions
+	 * A word comes before the ones it prefixes, so the node itself is
+	 * the answer if it has the highest count. Otherwise goes to the first
+	 * child (in lexicographic order) having the highest count
 	 */
-	if (node->end_of_word) {
-		if (strlen(complete) == strlen(prefix)) {
-			strcpy(complete, current);
+	while (!TRIE_READ(pool[node].end_of_word) ||
+		   TRIE_READ(pool[node].count_word) < TRIE_READ(pool[node].max_count)) {
+		unsigned int best = TRIE_READ(pool[node].child);
+		if (!best)
+			break;
+
+		for (unsigned int child = TRIE_READ(pool[best].next); child;
+			 child = TRIE_READ(pool[child].next)) {
+			if (TRIE_READ(pool[child].max_count) >
+				TRIE_READ(pool[best].max_count))
+				best = child;
 		}
 
-		if (strlen(current) < strlen(complete)) {
-			strcpy(complete, current);
-		}
-
-		return;
+		trie_reserve(complete, size, len + 1);
+		(*complete)[len++] = pool[best].letter;
+		node = best;
+		COUNT(visited, 1);
 	}
 
+	(*complete)[len] = '\0';
+}
+
+/**
+ * Node reached by the ranked search, linked to the entry it was reached from
+ */
+typedef struct trail_t trail_t;
+struct trail_t {
+	unsigned int node; // the node
+	int parent; // entry of the parent, -1 for the prefix
+	int depth; // letters after the prefix
+};
+
+/**
+ * Candidate of the ranked search: either all the words of the subtree of
+ * an entry or only the word of the entry itself
+ */
+typedef struct candidate_t candidate_t;
+struct candidate_t {
+	long long key; // best rank of the words of the candidate
+	int entry; // the entry in the trail
+	int is_word; // 1 if only the word of the entry is meant
+};
+
+typedef struct ranked_t ranked_t;
+struct ranked_t {
+	trie_t *trie;
+	int criterion;
+	trail_t *trail; // every node reached, never removed
+	int trail_size, trail_capacity;
+	candidate_t *heap; // min-heap of the candidates
+	int heap_size, heap_capacity;
+};
+
+/**
+ * Lexicographic comparison of the words of two entries, walking up the
+ * trail until both reach the same parent
+ */
+static int trail_compare(ranked_t *ranked, int a, int b)
+{
+	trail_t *trail = ranked->trail;
+	int depth_a = trail[a].depth, depth_b = trail[b].depth;
+
+	while (trail[a].depth > trail[b].depth)
+		a = trail[a].parent;
+	while (trail[b].depth > trail[a].depth)
+		b = trail[b].parent;
+
 	/**
-	 *  Creates the word adding letter by letter
+	 * If a word is the prefix of the other one, it comes first
 	 */
-	for (int i = 0; i < ALPHABET_SIZE; i++) {
-		if (node->children[i]) {
-			size_t len = strlen(current);
-			current[len] = 'a' + i;
-			current[len + 1] = '\0';
+	if (a == b)
+		return depth_a - depth_b;
 
-			dfs_shortest(node->children[i], complete, current, prefix);
-			current[len] = '\0';
-		}
+	while (trail[a].parent != trail[b].parent) {
+		a = trail[a].parent;
+		b = trail[b].parent;
 	}
+
+	trie_node_t *pool = TRIE_READ(ranked->trie->pool);
+	return pool[trail[a].node].letter - pool[trail[b].node].letter;
 }
 
-void dfs_frequent(trie_node_t *node, char *complete, char *current, int *max)
+/**
+ * The candidates are ranked by key and then lexicographically. The
+ * subtree of an entry is expanded before its word is given
+ */
+static int candidate_before(ranked_t *ranked, candidate_t *a, candidate_t *b)
 {
+	if (a->key != b->key)
+		return a->key < b->key;
+
+	int cmp = trail_compare(ranked, a->entry, b->entry);
+	if (cmp)
+		return cmp < 0;
+
+	return a->is_word < b->is_word;
+}
+
+static void ranked_push(ranked_t *ranked, int entry, int is_word)
+{
+	trie_node_t *pool = TRIE_READ(ranked->trie->pool);
+	trie_node_t *node = &pool[ranked->trail[entry].node];
+	int depth = ranked->trail[entry].depth;
+	long long key = 0;
+
 	/**
-	 * Compares every word's frequency with a maximum
-	 * variable and assigns the word in the output variable
+	 * The key of a subtree is the best one among its words, read from
+	 * the caches, so no word of it can rank before the subtree
 	 */
-	if (node->end_of_word) {
-		if (node->count_word > *max) {
-			strcpy(complete, current);
-			*max = node->count_word;
-		}
+	if (ranked->criterion == 2)
+		key = is_word ? depth : depth + TRIE_READ(node->shortest);
+	else if (ranked->criterion == 3)
+		key = is_word ? -TRIE_READ(node->count_word) :
+			  -TRIE_READ(node->max_count);
+
+	if (ranked->heap_size == ranked->heap_capacity) {
+		ranked->heap_capacity *= 2;
+		ranked->heap = realloc(ranked->heap, ranked->heap_capacity *
+							   sizeof(candidate_t));
+		DIE(!ranked->heap, "Realloc for ranked candidates failed");
 	}
 
+	candidate_t *heap = ranked->heap;
+	int i = ranked->heap_size++;
+	heap[i].key = key;
+	heap[i].entry = entry;
+	heap[i].is_word = is_word;
+
+	while (i && candidate_before(ranked, &heap[i], &heap[(i - 1) / 2])) {
+		candidate_t aux = heap[i];
+		heap[i] = heap[(i - 1) / 2];
+		heap[(i - 1) / 2] = aux;
+		i = (i - 1) / 2;
+	}
+}
+
+static candidate_t ranked_pop(ranked_t *ranked)
+{
+	candidate_t *heap = ranked->heap;
+	candidate_t top = heap[0];
+	heap[0] = heap[--ranked->heap_size];
+
+	int i = 0;
+	while (1) {
+		int best = i, left = 2 * i + 1, right = 2 * i + 2;
+
+		if (left < ranked->heap_size &&
+			candidate_before(ranked, &heap[left], &heap[best]))
+			best = left;
+		if (right < ranked->heap_size &&
+			candidate_before(ranked, &heap[right], &heap[best]))
+			best = right;
+
+		if (best == i)
+			break;
+
+		candidate_t aux = heap[i];
+		heap[i] = heap[best];
+		heap[best] = aux;
+		i = best;
+	}
+
+	return top;
+}
+
+static int ranked_add_entry(ranked_t *ranked, unsigned int node, int parent)
+{
+	if (ranked->trail_size == ranked->trail_capacity) {
+		ranked->trail_capacity *= 2;
+		ranked->trail = realloc(ranked->trail, ranked->trail_capacity *
+								sizeof(trail_t));
+		DIE(!ranked->trail, "Realloc for ranked trail failed");
+	}
+
+	int entry = ranked->trail_size++;
+	ranked->trail[entry].node = node;
+	ranked->trail[entry].parent = parent;
+	ranked->trail[entry].depth = parent < 0 ? 0 :
+								 ranked->trail[parent].depth + 1;
+
+	return entry;
+}
+
+void autocomplete_top(trie_t *trie, unsigned int node, const char *prefix,
+					  int criterion, int n, trie_output_t *out)
+{
+	ranked_t ranked;
+	ranked.trie = trie;
+	ranked.criterion = criterion;
+
+	ranked.trail_size = 0;
+	ranked.trail_capacity = 64;
+	ranked.trail = malloc(ranked.trail_capacity * sizeof(trail_t));
+	DIE(!ranked.trail, "Malloc for ranked trail failed");
+
+	ranked.heap_size = 0;
+	ranked.heap_capacity = 64;
+	ranked.heap = malloc(ranked.heap_capacity * sizeof(candidate_t));
+	DIE(!ranked.heap, "Malloc for ranked candidates failed");
+
+	size_t prefix_len = strlen(prefix);
+	int found = 0;
+
+	/**
+	 * The words are built in the same buffer, grown when one is longer
+	 */
+	size_t word_size = prefix_len + MAX_COMPLETE;
+	char *word = malloc(word_size);
+	DIE(!word, "Malloc for ranked word failed");
+
 	/**
-	 *  Creates the word adding letter by letter
+	 * Best-first search: the best candidate is taken every time. A word
+	 * is reported, while a subtree is replaced by its word and its children,
+	 * so only the nodes leading to the first n words are reached
 	 */
-	for (int i = 0; i < ALPHABET_SIZE; i++) {
-		if (node->children[i]) {
-			size_t len = strlen(current);
-			current[len] = 'a' + i;
-			current[len + 1] = '\0';
+	ranked_push(&ranked, ranked_add_entry(&ranked, node, -1), 0);
 
-			dfs_frequent(node->children[i], complete, current, max);
-			current[len] = '\0';
+	while (ranked.heap_size && found < n) {
+		candidate_t top = ranked_pop(&ranked);
+		trail_t entry = ranked.trail[top.entry];
+
+		trie_node_t *pool = TRIE_READ(trie->pool);
+
+		if (top.is_word) {
+			trie_reserve(&word, &word_size, prefix_len + entry.depth);
+
+			memcpy(word, prefix, prefix_len);
+			word[prefix_len + entry.depth] = '\0';
+			for (int e = top.entry; ranked.trail[e].parent >= 0;
+				 e = ranked.trail[e].parent)
+				word[prefix_len + ranked.trail[e].depth - 1] =
+					pool[ranked.trail[e].node].letter;
+
+			trie_report(out, word);
+			found++;
+			continue;
 		}
+
+		COUNT(visited, 1);
+		if (TRIE_READ(pool[entry.node].end_of_word))
+			ranked_push(&ranked, top.entry, 1);
+
+		for (unsigned int child = TRIE_READ(pool[entry.node].child); child;
+			 child = TRIE_READ(pool[child].next))
+			ranked_push(&ranked, ranked_add_entry(&ranked, child, top.entry),
+						0);
 	}
+
+	free(word);
+	free(ranked.heap);
+	free(ranked.trail);
 }
 
-void autocomplete(trie_t *trie, char *prefix, int criterion)
+int autocomplete(trie_t *trie, const char *prefix, int criterion, int n,
+				 trie_callback_t callback, void *data)
 {
-	char *current = malloc(MAX_COMPLETE * sizeof(char));
-	DIE(!current, "Malloc for current word allocation failed");
-
-	char *complete = malloc(MAX_COMPLETE * sizeof(char));
-	DIE(!complete, "Malloc for lexico word allocation failed");
-
-	strcpy(current, prefix);
-	strcpy(complete, prefix);
+	trie_output_t out = {callback, data, 0};
+	unsigned int node = 0;
 
-	trie_node_t *node = trie->root;
+	if (n <= 0)
+		return 0;
 
 	/**
 	 * Goes through the prefix in trie (it doesn't make sense to start
-	 * from the root if the word to be displayed starts with this prefix)
+	 * from the root if the word to be reported starts with this prefix)
 	 */
-	for (int i = 0; prefix[i] != '\0' && node; i++) {
+	for (int i = 0; prefix[i] != '\0'; i++) {
 		int index = prefix[i] - 'a';
-		node = node->children[index];
+		node = trie_child(trie, node, index);
+		if (!node)
+			break;
 	}
 
 	/**
 	 * If the prefix doesn't exits no word can be founded
 	 */
-	if (!node) {
-		if (!criterion) {
-			printf("No words found\n");
-			printf("No words found\n");
-			printf("No words found\n");
-		
-		} else {
-			printf("No words found\n");
-		}
-		
-		free(complete);
-		free(current);
-		return;
+	if (!node || TRIE_READ(TRIE_READ(trie->pool)[node].shortest) == NO_WORD)
+		return 0;
+
+	/**
+	 * More than one word is given by the ranked search
+	 */
+	if (n > 1) {
+		autocomplete_top(trie, node, prefix, criterion, n, &out);
+		return out.found;
 	}
 
-	int ok = 0, max = 0;
+	/**
+	 * The shortest word is known to have the cached number of letters
+	 * after the prefix. The buffer grows if the others are longer
+	 */
+	size_t len = strlen(prefix);
+	size_t size = len + 1 + (criterion == 2 ?
+		TRIE_READ(TRIE_READ(trie->pool)[node].shortest) : MAX_COMPLETE);
 
-	if (criterion == 1) {
-		dfs_lexico(node, complete, &ok);
+	char *complete = malloc(size * sizeof(char));
+	DIE(!complete, "Malloc for lexico word allocation failed");
+
+	memcpy(complete, prefix, len + 1);
 
+	/**
+	 * The shortest and the most frequent words are read from the caches
+	 * of the nodes, without searching the subtree of the prefix
+	 */
+	if (criterion == 1) {
+		dfs_lexico(trie, node, &complete, &size, len, &out);
 	} else if (criterion == 2) {
-		dfs_shortest(node, complete, current, prefix);
-		printf("%s\n", complete);
-	
+		complete_shortest(trie, node, &complete, &size);
+		trie_report(&out, complete);
 	} else if (criterion == 3) {
-		dfs_frequent(node, complete, current, &max);
-		printf("%s\n", complete);
-
-	} else {
-		dfs_lexico(node, complete, &ok);
-
-		dfs_shortest(node, complete, current, prefix);
-		printf("%s\n", complete);
-
-		dfs_frequent(node, complete, current, &max);
-		printf("%s\n", complete);
+		complete_frequent(trie, node, &complete, &size);
+		trie_report(&out, complete);
 	}
 
 	free(complete);
-	free(current);
+	return out.found;
 }
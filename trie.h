@@ -2,33 +2,170 @@
 #ifndef TRIE_H
 #define TRIE_H
 
+#include <pthread.h>
+#include <stddef.h>
+
 #include "utils.h"
 
 #define ALPHABET_SIZE 26
 #define MAX_COMPLETE 50  // predicted maximum length of a completed word
+#define NO_WORD 0xFFFF  // shortest of a subtree without words
+#define TRIE_MAGIC "MKTR"  // first bytes of a snapshot
+#define TRIE_VERSION 1  // layout of the snapshot
+#define TRIE_BYTE_ORDER 0x01020304  // read back differently on other endians
+#define TRIE_READERS 64  // threads that can search the trie at the same time
+
+/**
+ * The fields that a search reads while a writer may change them are
+ * accessed atomically. A writer fills a node before linking it and updates
+ * the caches from the bottom up, so a search following a link or a cache
+ * finds what it points to already in place.
+ */
+#define TRIE_READ(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#define TRIE_WRITE(field, value) \
+	__atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
 
+/**
+ * The nodes of a trie are kept in one contiguous pool and refer to each
+ * other by their index in it. The children of a node form a chain of
+ * siblings sorted by letter, and a bitmap tells which letters are present
+ * without walking the chain. Index 0 is the root, which is never a child,
+ * so 0 also marks a missing child or sibling.
+ *
+ * Every node also caches the best completion of its subtree for the
+ * autocomplete criteria: the highest count_word and the distance to the
+ * nearest word. They are kept up to date along the path of every
+ * insertion and removal.
+ */
 typedef struct trie_node_t trie_node_t;
 struct trie_node_t {
-	int end_of_word; // 1 if the subscript so far makes a word, 0 otherwise
-	int n_children;  // number of children of the node
+	unsigned int children; // bitmap of the letters of the children
+	unsigned int child; // index of the first (smallest letter) child
+	unsigned int next; // index of the next sibling, with a greater letter
 	int count_word;  // if end_of_word, the number of appearances increases
-	trie_node_t **children; // 26 letters array
+	int max_count; // the highest count_word in the subtree
+	unsigned short shortest; // letters to the nearest word, NO_WORD if none
+	char letter; // the letter of the node, 0 for the root
+	char end_of_word; // 1 if the subscript so far makes a word, 0 otherwise
+};
+
+/**
+ * Epoch of the trie when a thread started its search, 0 if it isn't
+ * searching. Every slot takes a cache line, so the threads don't share one.
+ */
+typedef struct trie_reader_t trie_reader_t;
+struct trie_reader_t {
+	unsigned long epoch;
+	char padding[64 - sizeof(unsigned long)];
+};
+
+/**
+ * Memory taken out of the trie while searches may still read it: an
+ * unlinked subtrie or a pool replaced by a larger one
+ */
+typedef struct trie_retired_t trie_retired_t;
+struct trie_retired_t {
+	unsigned long epoch; // epoch of the trie when it was retired
+	unsigned int node; // root of the subtrie, if there's no pool
+	trie_node_t *pool; // the replaced pool, NULL for a subtrie
+	size_t mapped; // bytes of the snapshot holding the pool, 0 if allocated
 };
 
 typedef struct trie_t trie_t;
 struct trie_t {
-	trie_node_t *root;
+	trie_node_t *pool; // all the nodes, the root being the first one
+	unsigned int used; // number of slots of the pool handed out
+	unsigned int capacity; // number of slots of the pool
+	unsigned int free_list; // released slots, linked through next, 0 if none
 	int size; // number of words in the trie
 	int nodes; // number of nodes in the trie
+	size_t mapped; // bytes of the snapshot holding the pool, 0 if allocated
+
+	pthread_mutex_t lock; // held by the writer
+	unsigned long epoch; // advanced every time memory is retired
+	trie_reader_t readers[TRIE_READERS]; // epochs of the running searches
+	trie_retired_t *retired; // memory waiting for the searches to end
+	int n_retired; // number of retired entries
+	int retired_capacity; // size of the retired array
 };
 
 /**
- * @brief The function returns a dynamically allocated
- * node structure with all fields initialized
+ * A snapshot is this header followed by the pool of the trie. The nodes
+ * refer to each other by index, so the pool is used straight from the
+ * mapped file.
+ */
+typedef struct trie_header_t trie_header_t;
+struct trie_header_t {
+	char magic[4]; // TRIE_MAGIC
+	unsigned int version; // TRIE_VERSION
+	unsigned int byte_order; // TRIE_BYTE_ORDER
+	unsigned int node_size; // sizeof(trie_node_t)
+	unsigned int used; // number of slots of the pool
+	unsigned int free_list; // released slots, linked through next
+	int size; // number of words in the trie
+	int nodes; // number of nodes in the trie
+};
+
+/**
+ * @brief Receives every word found by a search. The word is only valid
+ * during the call, so the callback copies it if it keeps it.
+ *
+ * @param word the word
+ * @param data the caller's context
+ */
+typedef void (*trie_callback_t)(const char *word, void *data);
+
+/**
+ * Where a search reports the words it finds
+ */
+typedef struct trie_output_t trie_output_t;
+struct trie_output_t {
+	trie_callback_t callback;
+	void *data; // passed to the callback
+	int found; // words reported so far
+};
+
+/**
+ * Words found by a search, copied one after another in memory of the
+ * caller, each one ending with '\0'. Give trie_words_add() as the callback
+ * of a search and the words as its data.
+ */
+typedef struct trie_words_t trie_words_t;
+struct trie_words_t {
+	char *buffer; // memory of the caller
+	size_t size; // its bytes
+	size_t used; // bytes taken by the words
+	int count; // words copied
+	int dropped; // words that didn't fit
+};
+
+/**
+ * @brief The number of children of a node
+ */
+#define trie_n_children(node) __builtin_popcount((node)->children)
+
+/**
+ * @brief The function takes a node out of the pool of the trie, reusing
+ * a released slot first and growing the pool if needed, and initializes
+ * all its fields. Pointers to nodes are no
+ * longer valid after this call, only their indices.
  * 
- * @return trie_node_t* 
+ * @param trie the trie
+ * @param letter the letter of the node
+ * @return unsigned int the index of the node
  */
-trie_node_t *trie_create_node(void);
+unsigned int trie_create_node(trie_t *trie, char letter);
+
+/**
+ * @brief The function returns the index of the child of a node
+ * for the given letter, 0 if there is no such child
+ * 
+ * @param trie the trie
+ * @param node the node
+ * @param letter the letter, 0 for 'a'
+ * @return unsigned int 
+ */
+unsigned int trie_child(trie_t *trie, unsigned int node, int letter);
 
 /**
  * @brief The function returns a dynamically allocated
@@ -39,7 +176,29 @@ trie_node_t *trie_create_node(void);
 trie_t *trie_create(void);
 
 /**
- * @brief The function inserts a new word in the trie
+ * @brief The function starts a search of a thread, which may then call
+ * autocomplete() and autocorrect() while other threads insert or remove
+ * words. The search never waits for the writer, and nothing it can reach
+ * is released or reused until trie_read_end().
+ * 
+ * @param trie the trie
+ * @param reader the slot of the thread, from 0 to TRIE_READERS - 1, used
+ * by a single thread at a time
+ */
+void trie_read_begin(trie_t *trie, int reader);
+
+/**
+ * @brief The function ends the search started by trie_read_begin()
+ * 
+ * @param trie the trie
+ * @param reader the slot of the thread
+ */
+void trie_read_end(trie_t *trie, int reader);
+
+/**
+ * @brief The function inserts a new word in the trie, if it's
+ * made only of letters from a to z. Writers are serialized by the lock
+ * of the trie.
  * 
  * @param trie the trie
  * @param key the key
@@ -47,18 +206,33 @@ trie_t *trie_create(void);
 void trie_insert(trie_t *trie, char *key);
 
 /**
- * @brief The function is called recursively from a node and frees
- * the memory of the entire subtree formed by this node
+ * @brief The function inserts the first len letters of key as a word in
+ * the trie, so a word can be inserted straight from a larger buffer. The
+ * caller holds the lock of the trie.
+ * 
+ * @param trie the trie
+ * @param key the key, having only letters from a to z
+ * @param len the length of the word
+ */
+void trie_insert_len(trie_t *trie, const char *key, size_t len);
+
+/**
+ * @brief The function is called recursively from a node and releases
+ * the entire subtree formed by this node. The node must already be
+ * unlinked from its parent and no search may still read it. The slots
+ * are put in the free list of the pool and are reused by the next nodes
+ * created.
  * 
  * @param trie the trie
  * @param node the node
  */
-void trie_free_subtrie(trie_t *trie, trie_node_t *node);
+void trie_free_subtrie(trie_t *trie, unsigned int node);
 
 /**
  * @brief The function deletes a word from the string. If the
  * word is a prefix of another word, only the end_of_word counter
- * for the word to be deleted is modified.
+ * for the word to be deleted is modified. The nodes taken out are
+ * released once the searches running at that time end.
  * 
  * @param trie the trie
  * @param key the key
@@ -73,77 +247,193 @@ void trie_remove(trie_t *trie, char *key);
 void trie_free(trie_t **ptrie);
 
 /**
- * @brief The function reads word by word from the file
- * and inserts it into the tree
+ * @brief The function returns the number of letters on the longest path
+ * from the root, which is the length of the longest word
+ * 
+ * @param trie the trie
+ * @return int 
+ */
+int trie_depth(trie_t *trie);
+
+/**
+ * @brief The function maps the file (or reads it in large blocks if it
+ * can't be mapped) and inserts every word into the tree straight from it.
+ * The words with characters outside a-z are skipped
+ * 
+ * @param trie the trie
+ * @param filename the file name
+ */
+void trie_load_file(trie_t *trie, char *filename);
+
+/**
+ * @brief The function writes a snapshot of the trie, its header and then
+ * the pool of nodes, which is written as it is
  * 
  * @param trie the trie
  * @param filename the file name
  */
-void load_file(trie_t *trie, char *filename);
+void trie_save(trie_t *trie, char *filename);
+
+/**
+ * @brief The function maps a snapshot saved by trie_save() and returns a
+ * trie using the nodes straight from the mapping, without reading them.
+ * Pages of the snapshot are copied only when written, and the whole pool
+ * is moved out of the mapping when it has to grow.
+ * 
+ * @param filename the file name
+ * @return trie_t* 
+ */
+trie_t *trie_open(char *filename);
 
 /**
- * @brief The function iterates (dfs) through the trie and displays
+ * @brief The function prepares the caller's buffer to receive words.
+ * 
+ * @param words the words
+ * @param buffer the memory of the caller
+ * @param size its bytes
+ */
+void trie_words_init(trie_words_t *words, char *buffer, size_t size);
+
+/**
+ * @brief A trie_callback_t copying the word at the end of a trie_words_t,
+ * or counting it as dropped if it doesn't fit.
+ * 
+ * @param word the word
+ * @param data the trie_words_t
+ */
+void trie_words_add(const char *word, void *data);
+
+/**
+ * @brief The function iterates (dfs) through the trie and reports
  * which words differ by k letters from the one received as input
  * 
+ * @param trie the trie
  * @param node the node 
  * @param word the word
  * @param correct the correct 
+ * @param depth the depth of the node, where its children's letter goes
  * @param diff teh difference
  * @param k count
- * @param ok sort fo boolean
+ * @param out where the words are reported
+ */
+void dfs_autocorrect(trie_t *trie, unsigned int node, const char *word,
+					 char *correct, int depth, int diff, int k,
+					 trie_output_t *out);
+
+typedef struct edit_search_t edit_search_t;
+
+/**
+ * @brief Iterates through the trie computing, for every node, one row of
+ * the Levenshtein table between the word built so far and the input word.
+ * Reports the words within distance k and drops the subtrees whose row
+ * has no distance within k.
+ * 
+ * @param search the state of the search
+ * @param node the node
+ * @param depth the depth of the node
  */
-void dfs_autocorrect(trie_node_t *node, char *word, char *correct, int diff,
-					 int k, int *ok);
+void dfs_edit(edit_search_t *search, unsigned int node, int depth);
 
 /**
- * @brief The function autocorrects a word using the dfs
+ * @brief The function autocorrects a word using the dfs, passing the words
+ * found to the callback in lexicographic order
  * 
  * @param trie teh trie
  * @param word teh word
- * @param k count
+ * @param k count, no word being found when it's negative
+ * @param mode 0 to only substitute letters, 1 to also insert and delete
+ * them (edit distance), 2 to also swap two neighbour letters
+ * @param callback receives every word
+ * @param data passed to the callback
+ * @return int the number of words found
  */
-void autocorrect(trie_t *trie, char *word, int k);
+int autocorrect(trie_t *trie, const char *word, int k, int mode,
+				trie_callback_t callback, void *data);
 
 /**
- * @brief Iterates through the trie using dfs and displays
+ * @brief Iterates through the trie using dfs and reports
  * the smallest lexicographic word with the given prefix
  * 
+ * @param trie the trie
  * @param node the node
- * @param complete the complete
- * @param ok boolean
+ * @param complete the complete, grown with realloc() when it's too short
+ * @param size the bytes of complete
+ * @param len the length of the word of the node
+ * @param out where the word is reported
+ * @return int 1 if a word was found, 0 otherwise
  */
-void dfs_lexico(trie_node_t *node, char *complete, int *ok);
+int dfs_lexico(trie_t *trie, unsigned int node, char **complete,
+			   size_t *size, int len, trie_output_t *out);
 
 /**
- * @brief Iterates through the trie using dfs and displays
- * the shortest word with the given prefix
+ * @brief The function recomputes the cached best completion of a node
+ * from its own word and the caches of its children
  * 
+ * @param trie the trie
  * @param node the node
- * @param complete the complete
- * @param current current word
- * @param prefix the prefix
+ * @return int 1 if the cache changed, 0 otherwise
  */
-void dfs_shortest(trie_node_t *node, char *complete, char *current,
-				  char *prefix);
+int trie_update_cache(trie_t *trie, unsigned int node);
 
 /**
- * @brief Iterates through the trie using dfs and displays
- * the most frequent word with the given prefix
+ * @brief Follows the cached distances from the node down to the shortest
+ * word of its subtree (the smallest lexicographic one if there are more)
+ * and appends its letters to complete
  * 
+ * @param trie the trie
  * @param node the node
- * @param complete the complete
- * @param current current node
- * @param max maximum
+ * @param complete the complete, grown with realloc() when it's too short
+ * @param size the bytes of complete
+ */
+void complete_shortest(trie_t *trie, unsigned int node, char **complete,
+					   size_t *size);
+
+/**
+ * @brief Follows the cached counts from the node down to the most frequent
+ * word of its subtree (the smallest lexicographic one if there are more)
+ * and appends its letters to complete
+ * 
+ * @param trie the trie
+ * @param node the node
+ * @param complete the complete, grown with realloc() when it's too short
+ * @param size the bytes of complete
+ */
+void complete_frequent(trie_t *trie, unsigned int node, char **complete,
+					   size_t *size);
+
+/**
+ * @brief Reports the first n words of the subtree of a node for the given
+ * criterion (1 lexicographic, 2 shortest, 3 most frequent, the ties being
+ * broken lexicographically). It's a best-first search over the subtree,
+ * ranking every subtree by the cached best word in it, so its cost grows
+ * with n and not with the size of the subtree.
+ * 
+ * @param trie the trie
+ * @param node the node of the prefix
+ * @param prefix the prefix
+ * @param criterion the autocomplete criterion
+ * @param n how many words are reported
+ * @param out where the words are reported
  */
-void dfs_frequent(trie_node_t *node, char *complete, char *current, int *max); 
+void autocomplete_top(trie_t *trie, unsigned int node, const char *prefix,
+					  int criterion, int n, trie_output_t *out);
 
 /**
- * @brief The function autocompletes the word using the dfs function
+ * @brief The function passes to the callback the first n completions of
+ * the prefix for a criterion (1 lexicographic, 2 shortest, 3 most
+ * frequent). Searches don't change the trie, so they can run in several
+ * threads, between trie_read_begin() and trie_read_end() if a writer may
+ * run too.
  * 
  * @param trie the trie
  * @param prefix the prefix
  * @param criterion the autocomplete criterion
+ * @param n how many words are reported, none when it's not positive
+ * @param callback receives every word
+ * @param data passed to the callback
+ * @return int the number of words found
  */
-void autocomplete(trie_t *trie, char *prefix, int criterion);
+int autocomplete(trie_t *trie, const char *prefix, int criterion, int n,
+				 trie_callback_t callback, void *data);
 
 #endif
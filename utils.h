@@ -6,6 +6,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#define LOAD_BLOCK (1 << 20)  // bytes read at once from a file not mapped
+
 /* useful macro for handling error codes */
 #define DIE(assertion, call_description)                                       \
 	do {                                                                       \
@@ -16,4 +18,14 @@
 		}                                                                      \
 	} while (0)
 
+/* the same for invalid input, where errno tells nothing */
+#define INVALID(assertion, description)                                        \
+	do {                                                                       \
+		if (assertion) {                                                       \
+			fprintf(stderr, "(%s, %d): %s\n", __FILE__, __LINE__,              \
+					description);                                              \
+			exit(EXIT_FAILURE);                                                \
+		}                                                                      \
+	} while (0)
+
 #endif /* UTILS_H_ */